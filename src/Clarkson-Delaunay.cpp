@@ -116,71 +116,73 @@ Then free the array:
 -------------------------------------------------------------------------------------- */
 
 
-static int *ptrToIntsToIndex, *listOfIntsToIndex;
-static float *ptrFloatsToIndex, *listOfFloatsToIndex, mult_up;
+// Thread-local so that several dungeons can be triangulated at once by batch generation
 
-static WORD *ptrToOutputList ;
-static int triangleDirection;
+static thread_local int *ptrToIntsToIndex, *listOfIntsToIndex;
+static thread_local float *ptrFloatsToIndex, *listOfFloatsToIndex, mult_up;
 
-static int numPointsProcessed;
-static int totalInputPoints;
-static int maxOutputEntries ;
-static int currenOutputIndex;
+static thread_local WORD *ptrToOutputList ;
+static thread_local int triangleDirection;
+
+static thread_local int numPointsProcessed;
+static thread_local int totalInputPoints;
+static thread_local int maxOutputEntries ;
+static thread_local int currenOutputIndex;
 static void triangleList_out (int v0, int v1, int v2, int v3);
 
-static point site_blocks[MAXBLOCKS];
-static int   num_blocks;
+static thread_local point site_blocks[MAXBLOCKS];
+static thread_local int   num_blocks;
 
 // The next block of variables were static variables within functions that I moved
 // outside of the function.  I prepended each of the variables with the name of the function.
 // For example: sc_lscale was originally "lscale" in sc()
 //              visit_triang_gen_ss was originally "ss" in visit_triang_gen()
 //              search_ss was originally "ss" in search()
-static long get_next_site_s_num;
-static neighbor out_of_flat_p_neigh;
-static basis_s *sees_b;
-static long visit_triang_gen_vnum;
-static long visit_triang_gen_ss;
-static simplex **visit_triang_gen_st;
-static simplex **search_st;
-static long search_ss;
-static int   sc_lscale;
-static double   sc_max_scale, sc_ldetbound, sc_Sb;
-static simplex *make_facets_ns;
+static thread_local long get_next_site_s_num;
+static thread_local neighbor out_of_flat_p_neigh;
+static thread_local basis_s *sees_b;
+static thread_local long visit_triang_gen_vnum;
+static thread_local long visit_triang_gen_ss;
+static thread_local simplex **visit_triang_gen_st;
+static thread_local simplex **search_st;
+static thread_local long search_ss;
+static thread_local int   sc_lscale;
+static thread_local double   sc_max_scale, sc_ldetbound, sc_Sb;
+static thread_local simplex *make_facets_ns;
 
 // --------- from ch.c : numerical functions for hull computation ---------
 const int    EXACT_BITS = 53;   // = (int)floor (DBL_MANT_DIG * log ((double)FLT_RADIX) / log(2.) );
 const double B_ERR_MIN = (float)(DBL_EPSILON*MAXDIM*(1<<MAXDIM)*MAXDIM*3.01);
 const double B_ERR_MIN_SQ = B_ERR_MIN * B_ERR_MIN;
 
-static Coord  hull_infinity[10]={57.2,0,0,0,0}; /* point at infinity for Delaunay triangulation; value not used */
+static thread_local Coord  hull_infinity[10]={57.2,0,0,0,0}; /* point at infinity for Delaunay triangulation; value not used */
 
-static basis_s   tt_basis = {0,1,-1,0,0,0},
+static thread_local basis_s   tt_basis = {0,1,-1,0,0,0},
                  *tt_basisp = &tt_basis,
                  *infinity_basis;
 
-static int   pdim;   /* point dimension */
-static simplex *ch_root;
+static thread_local int   pdim;   /* point dimension */
+static thread_local simplex *ch_root;
 
 #define DELIFT 0
-static int basis_vec_size;
+static thread_local int basis_vec_size;
 
 // ------ from hull.c : "combinatorial" functions for hull computation
-static long pnum;
-static site p;
-static int  rdim,   /* region dimension: (max) number of sites specifying region */
+static thread_local long pnum;
+static thread_local site p;
+static thread_local int  rdim,   /* region dimension: (max) number of sites specifying region */
             cdim,   /* number of sites currently specifying region */
             site_size, /* size of malloc needed for a site */
             point_size;  /* size of malloc needed for a point */
 
 // STORAGE(simplex)    expands into:
- size_t simplex_size;
- simplex *simplex_list = 0;
+ thread_local size_t simplex_size;
+ thread_local simplex *simplex_list = 0;
  simplex *new_block_simplex(int make_blocks)  {
     int i;
-    static simplex *simplex_block_table[max_blocks];
+    static thread_local simplex *simplex_block_table[max_blocks];
     simplex *xlm, *xbt;
-    static int num_simplex_blocks;
+    static thread_local int num_simplex_blocks;
     if (make_blocks)  {
       xbt = simplex_block_table[num_simplex_blocks++] = (simplex*)malloc(Nobj * simplex_size);
       memset(xbt, 0, Nobj *simplex_size);
@@ -203,13 +205,13 @@ static int  rdim,   /* region dimension: (max) number of sites specifying region
 
 
 // STORAGE(basis_s)    expands into:
- size_t basis_s_size;
- basis_s *basis_s_list = 0;
+ thread_local size_t basis_s_size;
+ thread_local basis_s *basis_s_list = 0;
  basis_s *new_block_basis_s(int make_blocks) {
     int i;
-    static basis_s *basis_s_block_table[max_blocks];
+    static thread_local basis_s *basis_s_block_table[max_blocks];
     basis_s *xlm, *xbt;
-    static int num_basis_s_blocks;
+    static thread_local int num_basis_s_blocks;
  if (make_blocks) {
     xbt = basis_s_block_table[num_basis_s_blocks++] = (basis_s*)malloc(Nobj *basis_s_size);
     memset(xbt,0,Nobj *basis_s_size);
@@ -585,6 +587,9 @@ if (visit_triang_gen_st)
    free (visit_triang_gen_st);
 if (search_st)
    free (search_st);
+if (out_of_flat_p_neigh.basis)
+   free (out_of_flat_p_neigh.basis);
+out_of_flat_p_neigh.basis = 0;
 }
 
 // ----------------------------------------------------------------
@@ -37,8 +37,8 @@ typedef struct basis_s {
 } basis_s;
 
 //STORAGE_GLOBALS(basis_s)
-  extern size_t basis_s_size;
-  extern basis_s *basis_s_list;
+  extern thread_local size_t basis_s_size;
+  extern thread_local basis_s *basis_s_list;
   extern basis_s *new_block_basis_s(int);
   extern void flush_basis_s_blocks(void);
   void free_basis_s_storage(void);
@@ -60,8 +60,8 @@ typedef struct simplex {
    neighbor neigh[1];   /* neighbors of simplex */
 } simplex;
 // STORAGE_GLOBALS(simplex)
-  extern size_t simplex_size;
-  extern simplex *simplex_list;
+  extern thread_local size_t simplex_size;
+  extern thread_local simplex *simplex_list;
   extern simplex *new_block_simplex(int);
   extern void flush_simplex_blocks(void);
   void free_simplex_storage(void);
@@ -0,0 +1,109 @@
+/*
+ * Scratch arena
+ *
+ * A bump allocator over a chain of blocks. When an allocation doesn't fit in
+ * the current block it moves on to the next spare block if that one is big
+ * enough, and otherwise links a new block in after the current one, so a
+ * release never frees anything and the spare blocks are reused. arenaReset
+ * replaces a chain of several blocks with one block of their total size.
+ */
+
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+
+#include "arena.h"
+
+// block header size, rounded up so block data is aligned
+#define ARENA_HEADER ((sizeof(arena_block_t) + ARENA_ALIGN - 1) / ARENA_ALIGN * ARENA_ALIGN)
+
+static arena_block_t *newBlock(size_t size) {
+    void *memory = NULL;
+    if (posix_memalign(&memory, ARENA_ALIGN, ARENA_HEADER + size) != 0)
+        abort();
+    arena_block_t *block = (arena_block_t *)memory;
+    block->next = NULL;
+    block->size = size;
+    return block;
+}
+
+static char *blockData(arena_block_t *block) {
+    return (char *)block + ARENA_HEADER;
+}
+
+// frees the thread's arena when the thread exits
+struct scratch_holder_t {
+    arena_t arena;
+    scratch_holder_t() { memset(&arena, 0, sizeof(arena)); }
+    ~scratch_holder_t() { freeArena(&arena); }
+};
+
+arena_t *scratchArena() {
+    static thread_local scratch_holder_t holder;
+    return &holder.arena;
+}
+
+void *arenaAlloc(arena_t *arena, size_t bytes) {
+    bytes = std::max((bytes + ARENA_ALIGN - 1) / ARENA_ALIGN * ARENA_ALIGN, (size_t)ARENA_ALIGN);
+    if (!arena->current || arena->offset + bytes > arena->current->size) {
+        arena_block_t *spare = arena->current ? arena->current->next : arena->first;
+        if (!spare || bytes > spare->size) {
+            arena_block_t *block = newBlock(std::max(bytes, (size_t)ARENA_BLOCK_SIZE));
+            arena->reserved += block->size;
+            block->next = spare;
+            if (arena->current)
+                arena->current->next = block;
+            else
+                arena->first = block;
+            spare = block;
+        }
+        if (arena->current)
+            arena->usedBefore += arena->offset;
+        arena->current = spare;
+        arena->offset = 0;
+    }
+    void *p = blockData(arena->current) + arena->offset;
+    arena->offset += bytes;
+    arena->peak = std::max(arena->peak, arena->usedBefore + arena->offset);
+    return p;
+}
+
+void *arenaCalloc(arena_t *arena, size_t count, size_t size) {
+    void *p = arenaAlloc(arena, count * size);
+    memset(p, 0, count * size);
+    return p;
+}
+
+arena_mark_t arenaMark(arena_t *arena) {
+    arena_mark_t mark = {arena->current, arena->offset, arena->usedBefore};
+    return mark;
+}
+
+void arenaRelease(arena_t *arena, arena_mark_t mark) {
+    arena->current = mark.block;
+    arena->offset = mark.offset;
+    arena->usedBefore = mark.usedBefore;
+}
+
+void arenaReset(arena_t *arena) {
+    if (arena->first && arena->first->next) {
+        size_t total = arena->reserved;
+        freeArena(arena);
+        arena->first = newBlock(total);
+        arena->reserved = total;
+    }
+    arena->current = NULL;
+    arena->offset = 0;
+    arena->usedBefore = 0;
+    arena->peak = 0;
+}
+
+void freeArena(arena_t *arena) {
+    arena_block_t *block = arena->first;
+    while (block) {
+        arena_block_t *next = block->next;
+        free(block);
+        block = next;
+    }
+    memset(arena, 0, sizeof(arena_t));
+}
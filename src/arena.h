@@ -0,0 +1,54 @@
+/*
+ * Scratch memory arena.
+ *
+ * The stages allocate their temporary arrays from the calling thread's
+ * scratch arena instead of malloc/free. A stage takes an arenaMark before its
+ * first allocation and hands it back to arenaRelease at the end, and
+ * runPipeline calls arenaReset once per dungeon. Blocks are kept across
+ * resets, and a reset folds a chain of blocks into one block big enough for
+ * the dungeon that needed them, so generating dungeons in a loop stops
+ * touching the heap for scratch memory after the first one. The exceptions
+ * are buffers that grow inside a parallel loop: the hallway sweep's crossing
+ * lists and active sets and routing's per-edge paths (see sweep.cpp and
+ * routing.cpp).
+ *
+ * Arena memory must not be allocated or released inside a parallel region,
+ * and nothing the dungeon keeps may come from it.
+ */
+
+#define ARENA_ALIGN      64         // every allocation starts on a cache line
+#define ARENA_BLOCK_SIZE (1 << 20)  // smallest block allocated
+
+typedef struct arena_block_t {
+    struct arena_block_t *next;
+    size_t size;                    // usable bytes after the header
+} arena_block_t;
+
+typedef struct {
+    arena_block_t *first;
+    arena_block_t *current;         // block allocations come from, later blocks are spare
+    size_t offset;                  // bytes used in current
+    size_t usedBefore;              // bytes used in the blocks before current
+    size_t peak;                    // most bytes in use at once since the last reset
+    size_t reserved;                // bytes held in blocks
+} arena_t;
+
+typedef struct {
+    arena_block_t *block;
+    size_t offset;
+    size_t usedBefore;
+} arena_mark_t;
+
+/* This thread's scratch arena, freed when the thread exits */
+arena_t *scratchArena();
+
+void *arenaAlloc(arena_t *arena, size_t bytes);
+void *arenaCalloc(arena_t *arena, size_t count, size_t size);
+
+arena_mark_t arenaMark(arena_t *arena);
+/* Frees everything allocated since mark */
+void arenaRelease(arena_t *arena, arena_mark_t mark);
+
+/* Frees everything and starts a new peak */
+void arenaReset(arena_t *arena);
+void freeArena(arena_t *arena);
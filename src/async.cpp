@@ -0,0 +1,121 @@
+/*
+ * Background generation
+ *
+ * The handle owns a copy of the params with control pointing at its own
+ * gen_control_t, so the stages see the cancel flag and deadline through
+ * dungeon->params like any other param. A pool worker (or the handle's own
+ * thread without one) runs the same three steps as runPipeline and then
+ * signals done. A cancelled result is freed there, so finishGeneration only
+ * ever hands out whole dungeons.
+ */
+
+#include <cstdlib>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <condition_variable>
+#include <omp.h>
+
+#include "generate.h"
+#include "graph.h"
+#include "tilemap.h"
+#include "validate.h"
+#include "cache.h"
+#include "pipeline.h"
+#include "control.h"
+#include "async.h"
+#include "pool.h"
+
+struct generation_t {
+    gen_params_t params;
+    int useRouting;
+    dungeon_cache_t *cache;
+    gen_control_t control;
+    pipeline_result_t result;
+    int status;                    // GEN_*, set once done
+    double start;                  // genClock() at startGeneration
+    std::mutex lock;
+    std::condition_variable ended;
+    bool done;
+    std::thread thread;            // only when the pool couldn't take the generation
+};
+
+static void runGeneration(generation_t *gen) {
+    gen_params_t *params = &gen->params;
+    int status = GEN_CANCELLED;
+    if (!genCancelled(&gen->control)) {
+        pipelineLayout(params, gen->useRouting, gen->cache, &gen->result);
+        pipelineHallways(params, gen->useRouting, gen->cache, &gen->result);
+        pipelineFinish(params, gen->useRouting, gen->cache, &gen->result);
+        // the result outlives the handle and its control
+        gen->result.dungeon.params.control = NULL;
+        if (genCancelled(&gen->control))
+            freePipelineResult(&gen->result);
+        else
+            status = gen->control.expired ? GEN_DEADLINE : GEN_COMPLETE;
+    }
+
+    std::lock_guard<std::mutex> guard(gen->lock);
+    gen->status = status;
+    gen->done = true;
+    gen->ended.notify_all();
+}
+
+static void runDetached(void *ctx) {
+    runGeneration((generation_t *)ctx);
+}
+
+static void runOnThread(generation_t *gen, int threads) {
+    // the stages' omp loops get the starting thread's team size
+    omp_set_num_threads(threads);
+    runGeneration(gen);
+}
+
+generation_t *startGeneration(gen_params_t *params, int useRouting, dungeon_cache_t *cache, double timeout) {
+    generation_t *gen = new generation_t();
+    gen->start = genClock();
+    initGenControl(&gen->control, timeout > 0 ? gen->start + timeout : 0);
+    gen->params = *params;
+    gen->params.control = &gen->control;
+    gen->useRouting = useRouting;
+    gen->cache = cache;
+    gen->status = GEN_CANCELLED;
+    gen->done = false;
+    if (!poolDetach(runDetached, gen))
+        gen->thread = std::thread(runOnThread, gen, omp_get_max_threads());
+    return gen;
+}
+
+void generationProgress(generation_t *gen, generation_progress_t *progress) {
+    progress->stage = gen->control.stage;
+    progress->iteration = gen->control.iteration;
+    progress->elapsed = genClock() - gen->start;
+    std::lock_guard<std::mutex> guard(gen->lock);
+    progress->done = gen->done;
+}
+
+void cancelGeneration(generation_t *gen) {
+    gen->control.cancelled = 1;
+}
+
+int waitGeneration(generation_t *gen, double seconds) {
+    std::unique_lock<std::mutex> wait(gen->lock);
+    if (seconds < 0)
+        gen->ended.wait(wait, [gen] { return gen->done; });
+    else
+        gen->ended.wait_for(wait, std::chrono::duration<double>(seconds), [gen] { return gen->done; });
+    return gen->done;
+}
+
+int finishGeneration(generation_t *gen, pipeline_result_t *result) {
+    waitGeneration(gen, -1);
+    if (gen->thread.joinable())
+        gen->thread.join();
+    int status = gen->status;
+    if (status == GEN_CANCELLED)
+        *result = pipeline_result_t();
+    else
+        *result = gen->result;
+    delete gen;
+    return status;
+}
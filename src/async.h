@@ -0,0 +1,54 @@
+/*
+ * Background generation with progress, cancellation and deadlines.
+ *
+ * startGeneration runs the pipeline steps for one dungeon in the background
+ * and returns a handle at once, which is used like a future: poll it with
+ * generationProgress, wait on it with waitGeneration, and take the result
+ * with finishGeneration, which also frees the handle. cancelGeneration stops
+ * the generation at its next check (see control.h), and a timeout makes the
+ * iterative stages stop where they are and hand back a best-effort dungeon.
+ *
+ * Under the work-stealing pool the generation is a detached pool task (see
+ * pool.h): a worker runs its steps and idle threads steal pieces of its
+ * loops, as for runPipeline. A generation stays GEN_STAGE_QUEUED while every
+ * worker is busy with another one. Under the OpenMP runtime, or with one
+ * thread, it gets a thread of its own instead, whose omp loops use the
+ * starting thread's team size.
+ *
+ * Include after pipeline.h.
+ */
+
+// finishGeneration results
+#define GEN_COMPLETE  0  // ran to the end
+#define GEN_DEADLINE  1  // a stage stopped at the deadline, the dungeon is best effort
+#define GEN_CANCELLED 2  // cancelled, nothing is returned
+
+typedef struct generation_t generation_t;
+
+typedef struct {
+    int stage;       // GEN_STAGE_*
+    int iteration;   // separation iteration or routing pass within the stage
+    int done;        // finishGeneration won't block
+    double elapsed;  // seconds since startGeneration
+} generation_progress_t;
+
+/*
+ * Starts generating the dungeon for a copy of params and returns at once.
+ * timeout is in seconds from now, <= 0 for none. cache may be NULL, and must
+ * outlive the handle. Every handle has to be passed to finishGeneration.
+ */
+generation_t *startGeneration(gen_params_t *params, int useRouting, dungeon_cache_t *cache, double timeout);
+
+void generationProgress(generation_t *gen, generation_progress_t *progress);
+
+/* Asks the generation to stop and returns without waiting for it */
+void cancelGeneration(generation_t *gen);
+
+/* Waits up to seconds (< 0 for as long as it takes), returns 1 once the generation has ended */
+int waitGeneration(generation_t *gen, double seconds);
+
+/*
+ * Waits for the generation to end and frees gen. Moves the result into result
+ * unless it was cancelled, in which case result is left empty. Returns GEN_*.
+ */
+int finishGeneration(generation_t *gen, pipeline_result_t *result);
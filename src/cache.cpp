@@ -0,0 +1,171 @@
+/*
+ * Dungeon cache files
+ *
+ * Entries are dungeon files (see dungeonfile.h) named by the 64-bit FNV-1a
+ * hash of their generation params in hex. The params in the file header are
+ * the full key and are compared on load, so a hash collision or a file from
+ * an older format reads as a miss. A hit maps the file and copies the arrays
+ * out, since the pipeline result owns and frees its arrays. Files are written
+ * under a temporary name from mkstemp, unique across threads and processes,
+ * and renamed into place so a concurrent reader never sees half a file. A hit
+ * touches the file, so the modification time is the last use and eviction
+ * removes the oldest first.
+ * Eviction goes down to 90% of the bound so the directory scan isn't repeated
+ * on every store.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <vector>
+#include <algorithm>
+#include <omp.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <utime.h>
+#include <sys/stat.h>
+
+#include "generate.h"
+#include "dungeonfile.h"
+#include "cache.h"
+
+#define CACHE_SUFFIX ".dgn"
+
+typedef struct {
+    char path[512];
+    time_t used;
+    off_t size;
+} cache_entry_t;
+
+static void keyPath(dungeon_cache_t *cache, dungeon_file_params_t *key, char *path, size_t len) {
+    uint64_t hash = 0xCBF29CE484222325ULL;
+    unsigned char *bytes = (unsigned char *)key;
+    for (size_t i = 0; i < sizeof(dungeon_file_params_t); i++)
+        hash = (hash ^ bytes[i]) * 0x100000001B3ULL;
+    snprintf(path, len, "%s/%016llx" CACHE_SUFFIX, cache->dir, (unsigned long long)hash);
+}
+
+// Copies count elements out of the mapping into a new array
+static void *copyArray(const void *data, size_t size, int count) {
+    void *copy = malloc(size * (count > 0 ? count : 1));
+    if (count > 0)
+        memcpy(copy, data, size * count);
+    return copy;
+}
+
+int cacheLoad(dungeon_cache_t *cache, gen_params_t *params, int useRouting,
+              dungeon_t *dungeon, double_edge_t **mst_dela) {
+    dungeon_file_params_t key;
+    if (!dungeonFileParams(params, useRouting, &key))
+        return 0;
+    char path[512];
+    keyPath(cache, &key, path, sizeof(path));
+    dungeon_map_t *map = openDungeonFile(path);
+    if (!map)
+        return 0;
+    if (memcmp(&map->header->params, &key, sizeof(key)) != 0) {
+        closeDungeonFile(map);
+        return 0;
+    }
+
+    dungeon_t *stored = &map->dungeon;
+    dungeon->params = *params;
+    dungeon->numRooms = stored->numRooms;
+    dungeon->rooms = (rectangle_t *)copyArray(stored->rooms, sizeof(rectangle_t), stored->numRooms);
+    dungeon->numMainRooms = stored->numMainRooms;
+    dungeon->mainRoomIndices = (int *)copyArray(stored->mainRoomIndices, sizeof(int), stored->numMainRooms);
+    dungeon->numHallways = stored->numHallways;
+    dungeon->hallways = (hallway_t *)copyArray(stored->hallways, sizeof(hallway_t), stored->numHallways);
+    dungeon->numSegments = stored->numSegments;
+    dungeon->segments = (segment_t *)copyArray(stored->segments, sizeof(segment_t), stored->numSegments);
+    dungeon->numCrossings = stored->numCrossings;
+    dungeon->crossings = (crossing_t *)copyArray(stored->crossings, sizeof(crossing_t), stored->numCrossings);
+    dungeon->numDoors = stored->numDoors;
+    dungeon->doors = (door_t *)copyArray(stored->doors, sizeof(door_t), stored->numDoors);
+    *mst_dela = (double_edge_t *)malloc(sizeof(double_edge_t));
+    (*mst_dela)->dela_edges = map->mst_dela.dela_edges;
+    (*mst_dela)->dela = (edge_t *)copyArray(map->mst_dela.dela, sizeof(edge_t), map->mst_dela.dela_edges);
+    (*mst_dela)->mst_edges = map->mst_dela.mst_edges;
+    (*mst_dela)->mst = (edge_t *)copyArray(map->mst_dela.mst, sizeof(edge_t), map->mst_dela.mst_edges);
+    closeDungeonFile(map);
+
+    utime(path, NULL);
+    return 1;
+}
+
+// Deletes the least recently used files until the directory is below target
+// bytes, returns the bytes left
+static size_t cacheEvict(dungeon_cache_t *cache, size_t target) {
+    DIR *dir = opendir(cache->dir);
+    if (!dir)
+        return 0;
+    std::vector<cache_entry_t> entries;
+    size_t total = 0;
+    size_t suffixLen = strlen(CACHE_SUFFIX);
+    struct dirent *ent;
+    while ((ent = readdir(dir)) != NULL) {
+        size_t len = strlen(ent->d_name);
+        if (len <= suffixLen || strcmp(ent->d_name + len - suffixLen, CACHE_SUFFIX) != 0)
+            continue;
+        cache_entry_t entry;
+        struct stat st;
+        snprintf(entry.path, sizeof(entry.path), "%s/%s", cache->dir, ent->d_name);
+        if (stat(entry.path, &st) != 0)
+            continue;
+        entry.used = st.st_mtime;
+        entry.size = st.st_size;
+        entries.push_back(entry);
+        total += st.st_size;
+    }
+    closedir(dir);
+
+    std::sort(entries.begin(), entries.end(), [](const cache_entry_t &a, const cache_entry_t &b) {
+        if (a.used != b.used)
+            return a.used < b.used;
+        return strcmp(a.path, b.path) < 0;
+    });
+    for (size_t i = 0; i < entries.size() && total > target; i++) {
+        if (unlink(entries[i].path) == 0)
+            total -= entries[i].size;
+    }
+    return total;
+}
+
+void initDungeonCache(dungeon_cache_t *cache, const char *dir, size_t maxBytes) {
+    snprintf(cache->dir, sizeof(cache->dir), "%s", dir);
+    cache->maxBytes = maxBytes;
+    mkdir(cache->dir, 0755);
+    cache->usedBytes = cacheEvict(cache, maxBytes);
+}
+
+void cacheStore(dungeon_cache_t *cache, gen_params_t *params, int useRouting,
+                dungeon_t *dungeon, double_edge_t *mst_dela) {
+    dungeon_file_params_t key;
+    if (!dungeonFileParams(params, useRouting, &key))
+        return;
+    char path[512];
+    char tmpPath[600];
+    keyPath(cache, &key, path, sizeof(path));
+    // thread numbers aren't unique (pool and async threads are all thread 0
+    // to OpenMP), so the name comes from mkstemp
+    snprintf(tmpPath, sizeof(tmpPath), "%s.XXXXXX", path);
+    int fd = mkstemp(tmpPath);
+    if (fd < 0)
+        return;
+    fchmod(fd, 0644);
+    close(fd);
+
+    long size = writeDungeonFile(tmpPath, &key, dungeon, mst_dela);
+    if (size < 0 || rename(tmpPath, path) != 0) {
+        unlink(tmpPath);
+        return;
+    }
+
+    #pragma omp critical(dungeon_cache)
+    {
+        cache->usedBytes += size;
+        if (cache->usedBytes > cache->maxBytes)
+            cache->usedBytes = cacheEvict(cache, cache->maxBytes - cache->maxBytes / 10);
+    }
+}
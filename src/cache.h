@@ -0,0 +1,28 @@
+/*
+ * On-disk cache of generated dungeons.
+ *
+ * A dungeon is stored after fixRoomEdges as a dungeon file (see dungeonfile.h)
+ * under a hash of everything that decides its layout: seed, room count,
+ * radius, placement, size distributions, main room criteria, pExtra,
+ * maxIters, whether routing ran, and DUNGEON_ALGORITHM_VERSION. The files
+ * live in one directory, and the least recently used ones are deleted once
+ * the directory grows past maxBytes.
+ * Params with a user quantile function can't be hashed and always miss.
+ */
+
+typedef struct {
+    char dir[256];
+    size_t maxBytes;
+    size_t usedBytes;  // running estimate, the directory is only rescanned once it passes maxBytes
+} dungeon_cache_t;
+
+/* Creates dir if needed and trims it to maxBytes */
+void initDungeonCache(dungeon_cache_t *cache, const char *dir, size_t maxBytes);
+
+/* Fills dungeon and mst_dela from the cache, returns 1 on a hit and 0 on a miss */
+int cacheLoad(dungeon_cache_t *cache, gen_params_t *params, int useRouting,
+              dungeon_t *dungeon, double_edge_t **mst_dela);
+
+/* Stores the dungeon and evicts old entries past the size bound */
+void cacheStore(dungeon_cache_t *cache, gen_params_t *params, int useRouting,
+                dungeon_t *dungeon, double_edge_t *mst_dela);
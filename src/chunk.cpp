@@ -0,0 +1,257 @@
+/*
+ * Chunk generation
+ *
+ * Rooms are generated around the origin as usual, separated, and moved to the
+ * chunk center. Rooms that stick out past the margin are dropped, so a chunk
+ * never depends on its neighbours' rooms. The Delaunay/MST hallways then
+ * connect the remaining main rooms. Each portal gets one extra hallway to the
+ * nearest main room that leaves the portal perpendicular to the chunk edge,
+ * so no corridor ever runs along a seam.
+ *
+ * A portal position depends only on the world seed and the edge, and edges
+ * are named by the chunk east or south of them, so the two chunks sharing an
+ * edge compute the same tile.
+ */
+
+#include <cmath>
+#include <cstdlib>
+#include <cstdint>
+#include <limits>
+#include <algorithm>
+#include <omp.h>
+
+#include "generate.h"
+#include "rng.h"
+#include "geometry.h"
+#include "graph.h"
+#include "sweep.h"
+#include "tilemap.h"
+#include "validate.h"
+#include "cache.h"
+#include "pipeline.h"
+#include "chunk.h"
+#include "arena.h"
+
+// main rooms the Delaunay triangulation needs
+#define CHUNK_MIN_MAIN_ROOMS 3
+
+static uint64_t packCoords(int x, int y) {
+    return ((uint64_t)(uint32_t)x << 32) | (uint32_t)y;
+}
+
+void defaultChunkParams(chunk_params_t *params) {
+    defaultGenParams(&params->gen);
+    params->gen.numRooms = 40;
+    params->gen.radius = 20;
+    params->gen.verbose = 0;
+    params->chunkSize = 128;
+    params->margin = 2;
+}
+
+point_t chunkPortal(chunk_params_t *params, int cx, int cy, int side) {
+    int size = params->chunkSize;
+    int ex = cx + (side == CHUNK_EAST);
+    int ey = cy + (side == CHUNK_SOUTH);
+    int vertical = (side == CHUNK_WEST || side == CHUNK_EAST);
+    double u = rngUniform(params->gen.seed, packCoords(ex, ey), RNG_STREAM_PORTAL, vertical);
+    float offset = params->margin + (int)(u * (size - 2 * params->margin));
+    point_t at;
+    if (vertical) {
+        at.x = (float)ex * size;
+        at.y = (float)cy * size + offset;
+    }
+    else {
+        at.x = (float)cx * size + offset;
+        at.y = (float)ey * size;
+    }
+    return at;
+}
+
+// Moves the rooms by (shiftX, shiftY) and keeps those whose tiles lie in
+// [left, right] x [top, bottom], main room indices are remapped
+static void clipToChunk(dungeon_t *dungeon, int left, int top, int right, int bottom, int shiftX, int shiftY) {
+    rectangle_t *rooms = dungeon->rooms;
+    int *newIndex = (int *)malloc(sizeof(int) * (dungeon->numRooms > 0 ? dungeon->numRooms : 1));
+    int kept = 0;
+    for (int i = 0; i < dungeon->numRooms; i++) {
+        rectangle_t room = rooms[i];
+        room.center.x += shiftX;
+        room.center.y += shiftY;
+        float l, t, r, b;
+        tileSpan(room.center.x, room.width, &l, &r);
+        tileSpan(room.center.y, room.height, &t, &b);
+        if (l >= left && t >= top && r <= right && b <= bottom) {
+            newIndex[i] = kept;
+            rooms[kept++] = room;
+        }
+        else {
+            newIndex[i] = -1;
+        }
+    }
+
+    int numMain = 0;
+    for (int m = 0; m < dungeon->numMainRooms; m++) {
+        int index = newIndex[dungeon->mainRoomIndices[m]];
+        if (index >= 0)
+            dungeon->mainRoomIndices[numMain++] = index;
+    }
+    dungeon->numRooms = kept;
+    dungeon->numMainRooms = numMain;
+    free(newIndex);
+}
+
+// Promotes the largest remaining rooms until there are enough main rooms to triangulate
+static void ensureMainRooms(dungeon_t *dungeon) {
+    if (dungeon->numMainRooms >= CHUNK_MIN_MAIN_ROOMS || dungeon->numRooms <= dungeon->numMainRooms)
+        return;
+    char *isMain = (char *)calloc(dungeon->numRooms, 1);
+    for (int m = 0; m < dungeon->numMainRooms; m++)
+        isMain[dungeon->mainRoomIndices[m]] = 1;
+    int numMain = dungeon->numMainRooms;
+    while (numMain < CHUNK_MIN_MAIN_ROOMS && numMain < dungeon->numRooms) {
+        int best = -1;
+        for (int i = 0; i < dungeon->numRooms; i++) {
+            if (isMain[i])
+                continue;
+            if (best < 0 || dungeon->rooms[i].width * dungeon->rooms[i].height >
+                            dungeon->rooms[best].width * dungeon->rooms[best].height)
+                best = i;
+        }
+        isMain[best] = 1;
+        numMain++;
+    }
+    // main room indices stay in increasing order
+    dungeon->mainRoomIndices = (int *)realloc(dungeon->mainRoomIndices, sizeof(int) * numMain);
+    numMain = 0;
+    for (int i = 0; i < dungeon->numRooms; i++) {
+        if (isMain[i])
+            dungeon->mainRoomIndices[numMain++] = i;
+    }
+    dungeon->numMainRooms = numMain;
+    free(isMain);
+}
+
+// Stand-in for constructHallways when too few rooms survived to triangulate,
+// joins consecutive main rooms with L-shaped hallways
+static double_edge_t *chainMainRooms(dungeon_t *dungeon) {
+    int numHallways = std::max(dungeon->numMainRooms - 1, 0);
+    double_edge_t *mst_dela = (double_edge_t *)calloc(1, sizeof(double_edge_t));
+    mst_dela->mst = (edge_t *)malloc(sizeof(edge_t) * (numHallways > 0 ? numHallways : 1));
+    mst_dela->mst_edges = numHallways;
+    dungeon->hallways = (hallway_t *)malloc(sizeof(hallway_t) * (numHallways > 0 ? numHallways : 1));
+    dungeon->segments = (segment_t *)malloc(sizeof(segment_t) * (numHallways > 0 ? numHallways * 2 : 1));
+    for (int h = 0; h < numHallways; h++) {
+        int src = dungeon->mainRoomIndices[h];
+        int dest = dungeon->mainRoomIndices[h + 1];
+        point_t start = dungeon->rooms[src].center;
+        point_t end = dungeon->rooms[dest].center;
+        point_t middle = {start.x, end.y};
+        dungeon->hallways[h] = {start, middle, end};
+        dungeon->segments[h * 2] = {start, middle, h};
+        dungeon->segments[h * 2 + 1] = {middle, end, h};
+        mst_dela->mst[h] = {src, dest, (float)sqrt(pow(end.x - start.x, 2) + pow(end.y - start.y, 2))};
+    }
+    dungeon->numHallways = numHallways;
+    dungeon->numSegments = numHallways * 2;
+    return mst_dela;
+}
+
+// Appends the CHUNK_PORTALS portals as rooms and main rooms, each joined by one
+// hallway to its nearest main room
+static void addPortals(chunk_params_t *params, int cx, int cy, dungeon_t *dungeon, double_edge_t *mst_dela) {
+    int first = dungeon->numRooms;
+    int numRealMain = dungeon->numMainRooms;
+    dungeon->rooms = (rectangle_t *)realloc(dungeon->rooms, sizeof(rectangle_t) * (first + CHUNK_PORTALS));
+    dungeon->mainRoomIndices = (int *)realloc(dungeon->mainRoomIndices, sizeof(int) * (numRealMain + CHUNK_PORTALS));
+    dungeon->hallways = (hallway_t *)realloc(dungeon->hallways, sizeof(hallway_t) * (dungeon->numHallways + CHUNK_PORTALS));
+    dungeon->segments = (segment_t *)realloc(dungeon->segments, sizeof(segment_t) * (dungeon->numSegments + 2 * CHUNK_PORTALS));
+    mst_dela->mst = (edge_t *)realloc(mst_dela->mst, sizeof(edge_t) * (mst_dela->mst_edges + CHUNK_PORTALS));
+    rectangle_t *rooms = dungeon->rooms;
+
+    for (int side = 0; side < CHUNK_PORTALS; side++) {
+        point_t at = chunkPortal(params, cx, cy, side);
+        int portal = first + side;
+        rooms[portal].center = at;
+        rooms[portal].width = 1;
+        rooms[portal].height = 1;
+        rooms[portal].status = 0;
+        dungeon->mainRoomIndices[numRealMain + side] = portal;
+
+        int best = -1;
+        float bestDist = std::numeric_limits<float>::infinity();
+        for (int m = 0; m < numRealMain; m++) {
+            rectangle_t *room = &rooms[dungeon->mainRoomIndices[m]];
+            float dist = sqrt(pow(room->center.x - at.x, 2) + pow(room->center.y - at.y, 2));
+            if (dist < bestDist) {
+                bestDist = dist;
+                best = dungeon->mainRoomIndices[m];
+            }
+        }
+        if (best < 0)
+            continue;
+
+        // leave the portal perpendicular to its edge, then turn toward the room
+        point_t target = rooms[best].center;
+        point_t middle;
+        if (side == CHUNK_WEST || side == CHUNK_EAST)
+            middle = {target.x, at.y};
+        else
+            middle = {at.x, target.y};
+        int h = dungeon->numHallways++;
+        dungeon->hallways[h] = {at, middle, target};
+        dungeon->segments[dungeon->numSegments++] = {at, middle, h};
+        dungeon->segments[dungeon->numSegments++] = {middle, target, h};
+        mst_dela->mst[mst_dela->mst_edges++] = {portal, best, bestDist};
+    }
+    dungeon->numRooms = first + CHUNK_PORTALS;
+    dungeon->numMainRooms = numRealMain + CHUNK_PORTALS;
+}
+
+void generateChunk(chunk_params_t *params, int cx, int cy, pipeline_result_t *result) {
+    dungeon_t *dungeon = &result->dungeon;
+    int size = params->chunkSize;
+    int margin = params->margin;
+    int x0 = cx * size;
+    int y0 = cy * size;
+
+    // chunks are small and generated side by side, so the stages' omp loops
+    // run serially inside a chunk
+    int max_threads = omp_get_max_threads();
+    omp_set_num_threads(1);
+    arena_t *arena = scratchArena();
+    arenaReset(arena);
+
+    gen_params_t gen = params->gen;
+    gen.seed = rngBits(params->gen.seed, packCoords(cx, cy), RNG_STREAM_CHUNK, 0);
+    generate(dungeon, &gen);
+    int separationIters = separateRooms(dungeon);
+    clipToChunk(dungeon, x0 + margin, y0 + margin, x0 + size - 1 - margin, y0 + size - 1 - margin,
+                x0 + size / 2, y0 + size / 2);
+    ensureMainRooms(dungeon);
+
+    if (dungeon->numMainRooms >= CHUNK_MIN_MAIN_ROOMS) {
+        result->mst_dela = constructHallways(dungeon);
+    }
+    else {
+        result->mst_dela = chainMainRooms(dungeon);
+    }
+    addPortals(params, cx, cy, dungeon, result->mst_dela);
+
+    mergeHallways(dungeon);
+    getIncludedRooms(dungeon);
+    // portals are corridor tiles, not rooms to draw
+    for (int side = 0; side < CHUNK_PORTALS; side++)
+        dungeon->rooms[dungeon->numRooms - CHUNK_PORTALS + side].status = 0;
+    fixRoomEdges(dungeon);
+
+    result->graph = buildRoomGraph(dungeon, result->mst_dela);
+    roomGraphStats(result->graph, 0, &result->graphStats);
+    result->tilemap = rasterizeDungeon(dungeon);
+    validateDungeon(dungeon, result->tilemap, &result->validation);
+    result->separationIters = separationIters;
+    result->overused = 0;
+    result->cached = 0;
+    result->scratchPeak = arena->peak;
+
+    omp_set_num_threads(max_threads);
+}
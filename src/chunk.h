@@ -0,0 +1,43 @@
+/*
+ * Chunked world generation.
+ *
+ * The world is cut into square chunks of chunkSize tiles and any chunk can be
+ * generated on its own, in any order. A chunk runs the normal pipeline on its
+ * own rooms, seeded from (seed, cx, cy), and keeps only the rooms that end up
+ * at least margin tiles inside its borders, so rooms of neighbouring chunks
+ * never overlap. Every shared chunk edge has one portal at a position derived
+ * from the seed and the edge alone. Both chunks run a corridor straight into
+ * the portal tile, so the corridors meet on the seam. The cost of a chunk does
+ * not depend on how many other chunks exist. The stages run single threaded
+ * inside a chunk, chunks can be generated in parallel.
+ *
+ * Include after pipeline.h.
+ */
+
+// chunk sides in the order their portals are appended to the rooms
+#define CHUNK_WEST  0
+#define CHUNK_EAST  1
+#define CHUNK_NORTH 2
+#define CHUNK_SOUTH 3
+
+// portals per chunk, the last rooms and main rooms of every chunk
+#define CHUNK_PORTALS 4
+
+typedef struct {
+    gen_params_t gen;  // rooms per chunk, radius, size distributions and the world seed
+    int chunkSize;     // tiles per chunk side
+    int margin;        // tiles along each chunk edge kept free of rooms
+} chunk_params_t;
+
+void defaultChunkParams(chunk_params_t *params);
+
+/* World tile where the portal on one side of chunk (cx, cy) sits */
+point_t chunkPortal(chunk_params_t *params, int cx, int cy, int side);
+
+/*
+ * Generates chunk (cx, cy), which owns tiles [cx * chunkSize, (cx + 1) * chunkSize)
+ * in x and likewise in y. The CHUNK_PORTALS portals are the last rooms and main
+ * rooms, with status 0 so they are not drawn. Corridors reach the portal tiles
+ * on the east and south edges, one column or row past the chunk.
+ */
+void generateChunk(chunk_params_t *params, int cx, int cy, pipeline_result_t *result);
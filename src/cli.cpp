@@ -0,0 +1,252 @@
+/*
+ * Headless command line front end
+ *
+ * Links against the generation library only, no SDL, so it runs on machines
+ * without a display and starts without initializing any of it. Every mode
+ * prints its results and exits:
+ *   default  one dungeon, prints its summary, -d 1 saves it to dungeon.dgn,
+ *            -T <seconds> generates it in the background with that time limit
+ *            and prints its progress meanwhile
+ *   -b N     N dungeons with consecutive seeds, one per thread, or with -m M
+ *            through the pipelined scheduler with at most M in flight (0 for
+ *            twice the thread count), -d 1 saves dungeon i to dungeon_<i>.dgn
+ *   -k N     chunks (0, 0) .. (N - 1, N - 1) of the world for the seed
+ *   -w N     N x N chunks streamed to world.dgw
+ * Generation params come from the options described in options.h, plus
+ *   -n threads  -a 1 hallway routing  -c <MB> cache in ./dungeon_cache
+ *   -t runtime for the irregular loops, 0 work-stealing pool, 1 OpenMP
+ *   -V 1 checks the included rooms against the sequential reference, for
+ *        one dungeon, and exits with 1 if they differ
+ * -h or --help prints the usage and exits.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <cstring>
+#include <chrono>
+#include <omp.h>
+
+#include "generate.h"
+#include "graph.h"
+#include "tilemap.h"
+#include "validate.h"
+#include "dungeonfile.h"
+#include "cache.h"
+#include "pipeline.h"
+#include "scheduler.h"
+#include "chunk.h"
+#include "world.h"
+#include "pool.h"
+#include "control.h"
+#include "async.h"
+#include "options.h"
+
+typedef std::chrono::high_resolution_clock Clock;
+typedef std::chrono::duration<double> dsec;
+
+#define DEFAULT_ROOMS 500
+
+// Where the batch sink sends each dungeon
+typedef struct {
+    FILE *out;        // one summary line per dungeon
+    int save;         // -d 1 also writes dungeon_<index>.dgn
+    int useRouting;
+    int failed;       // dungeons that could not be saved
+} batch_output_t;
+
+// Batch mode sink, ctx is a batch_output_t
+static void print_batch_result(int index, pipeline_result_t *result, void *ctx) {
+    batch_output_t *output = (batch_output_t *)ctx;
+    dungeon_t *dungeon = &result->dungeon;
+    fprintf(output->out, "dungeon %d seed %llu: %d separation iterations, %d main rooms, %d hallways, %d doors, %s\n",
+            index, (unsigned long long)dungeon->params.seed, result->separationIters, dungeon->numMainRooms,
+            result->mst_dela->mst_edges, dungeon->numDoors,
+            result->validation.connected ? "connected" : "DISCONNECTED");
+    if (output->save) {
+        char path[64];
+        snprintf(path, sizeof(path), "dungeon_%d.dgn", index);
+        dungeon_file_params_t file_params;
+        if (!dungeonFileParams(&dungeon->params, output->useRouting, &file_params) ||
+            writeDungeonFile(path, &file_params, dungeon, result->mst_dela) < 0) {
+            fprintf(output->out, "Could not write %s\n", path);
+            output->failed++;
+        }
+    }
+}
+
+static void print_usage(const char *program) {
+    printf("Usage: %s [-x value]...\n"
+           "  -b N      N dungeons with consecutive seeds, -m M pipelined with at most M in flight\n"
+           "  -k N      chunks (0, 0) .. (N - 1, N - 1) of the world\n"
+           "  -w N      N x N chunks streamed to world.dgw\n"
+           "  -T secs   one dungeon in the background with that time limit\n"
+           "  -d 1      save the dungeon to dungeon.dgn, or dungeon_<i>.dgn with -b\n"
+           "  -V 1      check the included rooms against the sequential reference\n"
+           "  -r rooms  -s seed  -p placement  -R radius  -e extra hallway chance  -i separation iterations\n"
+           "  -n threads  -a 1 hallway routing  -c MB cache in ./dungeon_cache\n"
+           "  -t runtime, 0 work-stealing pool, 1 OpenMP\n"
+           "  -h, --help  this message\n", program);
+}
+
+// Chunk and world params take the seed, room count and stage limits from the
+// options, chunk sizes and radius keep the chunk defaults
+static void chunkParamsFromGen(gen_params_t *gen, int roomsGiven, chunk_params_t *chunk) {
+    defaultChunkParams(chunk);
+    chunk->gen.seed = gen->seed;
+    if (roomsGiven)
+        chunk->gen.numRooms = gen->numRooms;
+    chunk->gen.maxIters = gen->maxIters;
+    chunk->gen.pExtra = gen->pExtra;
+}
+
+int main(int argc, char **argv) {
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0) {
+            print_usage(argv[0]);
+            return 0;
+        }
+    }
+    initOptions(argc, argv);
+    int num_of_threads = get_option_int("-n", 1);
+    int use_routing = get_option_int("-a", 0);
+    int batch_count = get_option_int("-b", 0);
+    int cache_mb = get_option_int("-c", 0);
+    int chunk_count = get_option_int("-k", 0);
+    int world_chunks = get_option_int("-w", 0);
+    int save_dungeon = get_option_int("-d", 0);
+    int verify = get_option_int("-V", 0);
+    int max_in_flight = get_option_int("-m", -1);
+    int runtime = get_option_int("-t", POOL_RUNTIME_STEALING);
+    float time_limit = get_option_float("-T", 0.0f);
+    omp_set_num_threads(num_of_threads);
+    initPool(num_of_threads, runtime);
+    printf("Number of threads: %d\n", num_of_threads);
+
+    gen_params_t params;
+    genParamsFromOptions(&params);
+    int rooms_given = params.numRooms > 0;
+    if (!rooms_given)
+        params.numRooms = DEFAULT_ROOMS;
+    unsigned long long seed = params.seed;
+
+    // world mode: w x w chunks streamed to world.dgw
+    if (world_chunks > 0) {
+        world_params_t world_params;
+        defaultWorldParams(&world_params);
+        chunkParamsFromGen(&params, rooms_given, &world_params.chunk);
+        world_params.chunksX = world_chunks;
+        world_params.chunksY = world_chunks;
+        printf("Streaming %d x %d chunks, %d rooms each, seed %llu to world.dgw\n", world_chunks, world_chunks,
+               world_params.chunk.gen.numRooms, seed);
+        auto world_start = Clock::now();
+        world_stats_t world_stats;
+        if (streamWorld(&world_params, "world.dgw", &world_stats) != 0) {
+            printf("Could not write world.dgw\n");
+            return 1;
+        }
+        double world_time = std::chrono::duration_cast<dsec>(Clock::now() - world_start).count();
+        printf("World Generation Time: %lfs (%llu rooms, %llu main rooms, %d disconnected chunks)\n", world_time,
+               (unsigned long long)world_stats.rooms, (unsigned long long)world_stats.mainRooms,
+               world_stats.disconnectedChunks);
+        return 0;
+    }
+
+    // chunk mode: chunks (0, 0) .. (k - 1, k - 1) of the world for the seed
+    if (chunk_count > 0) {
+        chunk_params_t chunk_params;
+        chunkParamsFromGen(&params, rooms_given, &chunk_params);
+        printf("Generating %d x %d chunks of %d tiles, %d rooms each, seed %llu\n", chunk_count, chunk_count,
+               chunk_params.chunkSize, chunk_params.gen.numRooms, seed);
+        auto chunk_start = Clock::now();
+        parallelFor(0, chunk_count * chunk_count, 1, [&](int i) {
+            int cx = i % chunk_count;
+            int cy = i / chunk_count;
+            pipeline_result_t result;
+            generateChunk(&chunk_params, cx, cy, &result);
+            #pragma omp critical(chunk_print)
+            printf("chunk (%d, %d): %d rooms, %d main rooms, %d hallways, %s\n", cx, cy,
+                   result.dungeon.numRooms - CHUNK_PORTALS, result.dungeon.numMainRooms - CHUNK_PORTALS, result.dungeon.numHallways,
+                   result.validation.connected ? "connected" : "DISCONNECTED");
+            freePipelineResult(&result);
+        });
+        double chunk_time = std::chrono::duration_cast<dsec>(Clock::now() - chunk_start).count();
+        printf("Chunk Generation Time: %lfs (%lf chunks/s)\n", chunk_time, chunk_count * chunk_count / chunk_time);
+        return 0;
+    }
+
+    // -c <MB> keeps generated dungeons in ./dungeon_cache, bounded to that size
+    dungeon_cache_t cache_store;
+    dungeon_cache_t *cache = NULL;
+    if (cache_mb > 0) {
+        initDungeonCache(&cache_store, "dungeon_cache", (size_t)cache_mb << 20);
+        cache = &cache_store;
+    }
+
+    // batch mode: many dungeons, one per thread
+    if (batch_count > 0) {
+        printf("Generating %d dungeons of %d rooms with seeds %llu..%llu\n",
+               batch_count, params.numRooms, seed, seed + batch_count - 1);
+        batch_output_t output = {stdout, save_dungeon, use_routing, 0};
+        auto batch_start = Clock::now();
+        if (max_in_flight >= 0) {
+            scheduler_params_t sched;
+            defaultSchedulerParams(&sched);
+            sched.maxInFlight = max_in_flight;
+            generatePipelined(&params, batch_count, use_routing, cache, &sched, print_batch_result, &output);
+        }
+        else {
+            generateBatch(&params, batch_count, use_routing, cache, print_batch_result, &output);
+        }
+        double batch_time = std::chrono::duration_cast<dsec>(Clock::now() - batch_start).count();
+        printf("Batch Generation Time: %lfs (%lf dungeons/s)\n", batch_time, batch_count / batch_time);
+        return output.failed ? 1 : 0;
+    }
+
+    printf("Generating %d Rooms with seed %llu\n", params.numRooms, seed);
+    pipeline_result_t result;
+    if (time_limit > 0) {
+        static const char *stages[] = {"queued", "layout", "hallways", "finish", "done"};
+        params.verbose = 0;
+        generation_t *gen = startGeneration(&params, use_routing, cache, time_limit);
+        while (!waitGeneration(gen, 0.25)) {
+            generation_progress_t progress;
+            generationProgress(gen, &progress);
+            printf("%.2fs: %s, iteration %d\n", progress.elapsed, stages[progress.stage], progress.iteration);
+        }
+        if (finishGeneration(gen, &result) == GEN_DEADLINE)
+            printf("Time limit reached, the dungeon is best effort\n");
+    }
+    else {
+        runPipeline(&params, use_routing, cache, &result);
+    }
+    printPipelineSummary(&result);
+
+    // a stopped generation has nothing to check or save
+    int finished = result.tilemap != NULL;
+    int status = finished ? 0 : 1;
+    if (verify && finished) {
+        int mismatches = verifyIncludedRooms(&result.dungeon);
+        if (mismatches == 0) {
+            printf("Included rooms match the sequential reference\n");
+        }
+        else {
+            printf("Included rooms MISMATCH: %d rooms differ from the sequential reference\n", mismatches);
+            status = 1;
+        }
+    }
+    // -d 1 also saves the dungeon to dungeon.dgn for loading with openDungeonFile
+    if (save_dungeon && finished) {
+        dungeon_file_params_t file_params;
+        if (dungeonFileParams(&params, use_routing, &file_params) &&
+            writeDungeonFile("dungeon.dgn", &file_params, &result.dungeon, result.mst_dela) >= 0) {
+            printf("Saved dungeon.dgn\n");
+        }
+        else {
+            printf("Could not write dungeon.dgn\n");
+            status = 1;
+        }
+    }
+    freePipelineResult(&result);
+    return status;
+}
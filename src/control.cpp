@@ -0,0 +1,52 @@
+/*
+ * Generation control
+ *
+ * The flags are atomics because the generation thread writes progress while
+ * another thread polls it, and cancellation comes from the polling side.
+ * genShouldStop reads the clock on every call, which is cheap next to one
+ * separation iteration or routing pass.
+ */
+
+#include <chrono>
+
+#include "control.h"
+
+double genClock() {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void initGenControl(gen_control_t *control, double deadline) {
+    control->stage = GEN_STAGE_QUEUED;
+    control->iteration = 0;
+    control->cancelled = 0;
+    control->expired = 0;
+    control->deadline = deadline;
+}
+
+void genSetStage(gen_control_t *control, int stage) {
+    if (!control)
+        return;
+    control->stage = stage;
+    control->iteration = 0;
+}
+
+int genShouldStop(gen_control_t *control, int iteration) {
+    if (!control)
+        return 0;
+    control->iteration = iteration;
+    if (control->cancelled)
+        return 1;
+    if (control->deadline > 0 && genClock() >= control->deadline) {
+        control->expired = 1;
+        return 1;
+    }
+    return 0;
+}
+
+int genCancelled(gen_control_t *control) {
+    return control && control->cancelled;
+}
+
+int genStoppedEarly(gen_control_t *control) {
+    return control && (control->cancelled || control->expired);
+}
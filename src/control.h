@@ -0,0 +1,53 @@
+/*
+ * Progress reporting and early stopping for one generation.
+ *
+ * A gen_control_t hangs off gen_params_t.control. The pipeline steps record
+ * which stage they are in, and the iterative stages (separateRooms and the
+ * routing negotiation) report their iteration and ask genShouldStop once per
+ * iteration. The other stages check genCancelled per room, strip or pass and
+ * skip the rest of their work, and pipelineFinish checks between stages, so
+ * a cancelled generation stops within one stage's item. Past the deadline
+ * only the iterative stages stop where they are, and the rest of the pipeline
+ * finishes the best-effort dungeon. Every function takes a NULL control,
+ * which never stops.
+ *
+ * One control belongs to one generation at a time. See async.h for running a
+ * generation in the background with one.
+ */
+
+#include <atomic>
+
+// gen_control_t stage
+#define GEN_STAGE_QUEUED   0
+#define GEN_STAGE_LAYOUT   1  // cache lookup, generate, separateRooms
+#define GEN_STAGE_HALLWAYS 2  // Delaunay, MST and routing
+#define GEN_STAGE_FINISH   3  // merge through validation
+#define GEN_STAGE_DONE     4
+
+typedef struct gen_control_t {
+    std::atomic<int> stage;      // GEN_STAGE_*
+    std::atomic<int> iteration;  // separation iteration or routing pass of the current stage
+    std::atomic<int> cancelled;  // stop everything, the result is thrown away
+    std::atomic<int> expired;    // a stage stopped early at the deadline
+    double deadline;             // genClock() seconds, 0 for none
+} gen_control_t;
+
+/* Monotonic seconds, the clock deadlines are given in */
+double genClock();
+
+/* Resets control for a new generation, deadline 0 for none */
+void initGenControl(gen_control_t *control, double deadline);
+
+void genSetStage(gen_control_t *control, int stage);
+
+/*
+ * Records iteration as the current stage's progress, returns 1 when the stage
+ * should stop iterating (cancelled, or past the deadline) and 0 otherwise
+ */
+int genShouldStop(gen_control_t *control, int iteration);
+
+/* Whether the generation was cancelled */
+int genCancelled(gen_control_t *control);
+
+/* Whether a stage stopped short of its own end, the dungeon is best effort */
+int genStoppedEarly(gen_control_t *control);
@@ -0,0 +1,97 @@
+/*
+ * Owning handle for a generated dungeon.
+ *
+ * The stages fill C structs of raw owning pointers (dungeon_t, double_edge_t
+ * and the rest of pipeline_result_t). A Dungeon takes over a finished
+ * pipeline_result_t and frees it exactly once when it goes away. It can be
+ * moved but not copied, so there is always one owner, and everything that
+ * only reads the dungeon (the renderer, exporters) works through read-only
+ * views into the owner's arrays instead of copies or aliases of the struct.
+ *
+ * Include after pipeline.h.
+ */
+
+#include <utility>
+
+// Read-only view of count elements owned by someone else
+template <typename T>
+struct view_t {
+    const T *data;
+    int count;
+
+    view_t() : data(NULL), count(0) {}
+    view_t(const T *data, int count) : data(data), count(data ? count : 0) {}
+    const T *begin() const { return data; }
+    const T *end() const { return data + count; }
+    const T &operator[](int i) const { return data[i]; }
+    int size() const { return count; }
+    bool empty() const { return count == 0; }
+};
+
+class Dungeon {
+    public:
+        Dungeon() : res(), owned(false) {}
+
+        // Takes ownership of a finished result, result is left empty
+        explicit Dungeon(pipeline_result_t *result) : res(*result), owned(true) {
+            *result = pipeline_result_t();
+        }
+
+        static Dungeon generate(gen_params_t *params, int useRouting, dungeon_cache_t *cache) {
+            pipeline_result_t result;
+            runPipeline(params, useRouting, cache, &result);
+            return Dungeon(&result);
+        }
+
+        ~Dungeon() {
+            if (owned)
+                freePipelineResult(&res);
+        }
+
+        Dungeon(Dungeon &&other) noexcept : res(other.res), owned(other.owned) {
+            other.owned = false;
+        }
+
+        Dungeon &operator=(Dungeon &&other) noexcept {
+            if (this != &other) {
+                if (owned)
+                    freePipelineResult(&res);
+                res = other.res;
+                owned = other.owned;
+                other.owned = false;
+            }
+            return *this;
+        }
+
+        Dungeon(const Dungeon &) = delete;
+        Dungeon &operator=(const Dungeon &) = delete;
+
+        bool valid() const { return owned; }
+
+        view_t<rectangle_t> rooms() const { return view_t<rectangle_t>(res.dungeon.rooms, res.dungeon.numRooms); }
+        view_t<int> mainRoomIndices() const { return view_t<int>(res.dungeon.mainRoomIndices, res.dungeon.numMainRooms); }
+        view_t<hallway_t> hallways() const { return view_t<hallway_t>(res.dungeon.hallways, res.dungeon.numHallways); }
+        view_t<segment_t> segments() const { return view_t<segment_t>(res.dungeon.segments, res.dungeon.numSegments); }
+        view_t<crossing_t> crossings() const { return view_t<crossing_t>(res.dungeon.crossings, res.dungeon.numCrossings); }
+        view_t<door_t> doors() const { return view_t<door_t>(res.dungeon.doors, res.dungeon.numDoors); }
+        view_t<edge_t> mstEdges() const {
+            return res.mst_dela ? view_t<edge_t>(res.mst_dela->mst, res.mst_dela->mst_edges) : view_t<edge_t>();
+        }
+        view_t<edge_t> delaunayEdges() const {
+            return res.mst_dela ? view_t<edge_t>(res.mst_dela->dela, res.mst_dela->dela_edges) : view_t<edge_t>();
+        }
+
+        const gen_params_t &params() const { return res.dungeon.params; }
+        const tilemap_t *tilemap() const { return res.tilemap; }
+        const room_graph_t *graph() const { return res.graph; }
+        const room_graph_stats_t &graphStats() const { return res.graphStats; }
+        const validation_t &validation() const { return res.validation; }
+
+        // For the C stages and functions that take dungeon_t, still owned by this
+        const dungeon_t *raw() const { return &res.dungeon; }
+        const pipeline_result_t *result() const { return &res; }
+
+    private:
+        pipeline_result_t res;
+        bool owned;
+};
@@ -0,0 +1,188 @@
+/*
+ * Dungeon files
+ *
+ * The writer lays the sections out back to back after the header, each padded
+ * up to DUNGEON_FILE_ALIGN, and writes the header last, so a file that was
+ * cut short never has a valid header. The reader maps the whole file and only
+ * checks the header and that every section lies inside the file; the
+ * dungeon_t it hands out points straight into the mapping.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "generate.h"
+#include "dungeonfile.h"
+
+static uint64_t alignUp(uint64_t x) {
+    return (x + DUNGEON_FILE_ALIGN - 1) / DUNGEON_FILE_ALIGN * DUNGEON_FILE_ALIGN;
+}
+
+// element size of every section, what this build's structs take
+static const uint32_t sectionElemSize[DUNGEON_SECTION_COUNT] = {
+    sizeof(rectangle_t), sizeof(int), sizeof(hallway_t), sizeof(segment_t),
+    sizeof(crossing_t), sizeof(door_t), sizeof(edge_t), sizeof(edge_t)
+};
+
+int dungeonFileParams(gen_params_t *params, int useRouting, dungeon_file_params_t *out) {
+    if (params->width.quantile || params->height.quantile)
+        return 0;
+    memset(out, 0, sizeof(dungeon_file_params_t));
+    out->seed = params->seed;
+    out->numRooms = params->numRooms;
+    out->radius = params->radius;
+    out->placement = params->placement;
+    out->mainCriterion = params->mainRooms.criterion;
+    out->width[0] = params->width.mean;
+    out->width[1] = params->width.stddev;
+    out->width[2] = params->width.min;
+    out->height[0] = params->height.mean;
+    out->height[1] = params->height.stddev;
+    out->height[2] = params->height.min;
+    out->mainRooms[0] = params->mainRooms.scale;
+    out->mainRooms[1] = params->mainRooms.percentile;
+    out->mainRooms[2] = params->mainRooms.maxAspect;
+    out->maxIters = params->maxIters;
+    out->pExtra = params->pExtra;
+    out->routing = useRouting;
+    out->algorithmVersion = DUNGEON_ALGORITHM_VERSION;
+    return 1;
+}
+
+// The gen_params_t a file was generated from
+static void genParamsFromFile(const dungeon_file_params_t *in, gen_params_t *params) {
+    defaultGenParams(params);
+    params->seed = in->seed;
+    params->numRooms = in->numRooms;
+    params->radius = in->radius;
+    params->placement = in->placement;
+    params->mainRooms.criterion = in->mainCriterion;
+    params->width.mean = in->width[0];
+    params->width.stddev = in->width[1];
+    params->width.min = in->width[2];
+    params->height.mean = in->height[0];
+    params->height.stddev = in->height[1];
+    params->height.min = in->height[2];
+    params->mainRooms.scale = in->mainRooms[0];
+    params->mainRooms.percentile = in->mainRooms[1];
+    params->mainRooms.maxAspect = in->mainRooms[2];
+    params->maxIters = in->maxIters;
+    params->pExtra = (float)in->pExtra;
+    params->verbose = 0;
+}
+
+long writeDungeonFile(const char *path, const dungeon_file_params_t *params, const dungeon_t *dungeon,
+                      const double_edge_t *mst_dela) {
+    const void *data[DUNGEON_SECTION_COUNT] = {
+        dungeon->rooms, dungeon->mainRoomIndices, dungeon->hallways, dungeon->segments,
+        dungeon->crossings, dungeon->doors, mst_dela->dela, mst_dela->mst
+    };
+    const int counts[DUNGEON_SECTION_COUNT] = {
+        dungeon->numRooms, dungeon->numMainRooms, dungeon->numHallways, dungeon->numSegments,
+        dungeon->numCrossings, dungeon->numDoors, mst_dela->dela_edges, mst_dela->mst_edges
+    };
+
+    dungeon_file_header_t header;
+    memset(&header, 0, sizeof(header));
+    header.byteOrder = DUNGEON_FILE_ORDER;
+    header.version = DUNGEON_FILE_VERSION;
+    header.headerSize = sizeof(dungeon_file_header_t);
+    header.numSections = DUNGEON_SECTION_COUNT;
+    header.params = *params;
+    uint64_t end = alignUp(sizeof(dungeon_file_header_t));
+    for (int s = 0; s < DUNGEON_SECTION_COUNT; s++) {
+        header.sections[s].offset = end;
+        header.sections[s].count = counts[s] > 0 ? counts[s] : 0;
+        header.sections[s].elemSize = sectionElemSize[s];
+        end = alignUp(end + header.sections[s].count * sectionElemSize[s]);
+    }
+
+    FILE *f = fopen(path, "wb");
+    if (!f)
+        return -1;
+    // gaps between sections and the header space read as zeros until the
+    // header goes in at the end, truncating to end covers empty trailing sections
+    int failed = 0;
+    for (int s = 0; s < DUNGEON_SECTION_COUNT && !failed; s++) {
+        size_t bytes = header.sections[s].count * sectionElemSize[s];
+        if (bytes > 0)
+            failed = fseek(f, (long)header.sections[s].offset, SEEK_SET) != 0 || fwrite(data[s], 1, bytes, f) != bytes;
+    }
+    if (!failed)
+        failed = fflush(f) != 0 || ftruncate(fileno(f), (off_t)end) != 0;
+    memcpy(header.magic, DUNGEON_FILE_MAGIC, 8);
+    if (!failed)
+        failed = fseek(f, 0, SEEK_SET) != 0 || fwrite(&header, sizeof(header), 1, f) != 1;
+    if (fclose(f) != 0 || failed)
+        return -1;
+    return (long)end;
+}
+
+dungeon_map_t *openDungeonFile(const char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return NULL;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(dungeon_file_header_t)) {
+        close(fd);
+        return NULL;
+    }
+    void *base = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED)
+        return NULL;
+
+    dungeon_file_header_t *header = (dungeon_file_header_t *)base;
+    int valid = memcmp(header->magic, DUNGEON_FILE_MAGIC, 8) == 0 && header->byteOrder == DUNGEON_FILE_ORDER &&
+                header->version == DUNGEON_FILE_VERSION && header->headerSize == sizeof(dungeon_file_header_t) &&
+                header->numSections == DUNGEON_SECTION_COUNT;
+    for (int s = 0; s < DUNGEON_SECTION_COUNT && valid; s++) {
+        dungeon_file_section_t *section = &header->sections[s];
+        valid = section->elemSize == sectionElemSize[s] && section->offset % DUNGEON_FILE_ALIGN == 0 &&
+                section->count <= INT32_MAX && section->offset <= (uint64_t)st.st_size &&
+                section->count * section->elemSize <= (uint64_t)st.st_size - section->offset;
+    }
+    if (!valid) {
+        munmap(base, st.st_size);
+        return NULL;
+    }
+
+    dungeon_map_t *map = (dungeon_map_t *)malloc(sizeof(dungeon_map_t));
+    map->header = header;
+    map->base = (unsigned char *)base;
+    map->size = st.st_size;
+    void *sections[DUNGEON_SECTION_COUNT];
+    for (int s = 0; s < DUNGEON_SECTION_COUNT; s++)
+        sections[s] = map->base + header->sections[s].offset;
+
+    dungeon_t *dungeon = &map->dungeon;
+    genParamsFromFile(&header->params, &dungeon->params);
+    dungeon->numRooms = (int)header->sections[DUNGEON_SECTION_ROOMS].count;
+    dungeon->rooms = (rectangle_t *)sections[DUNGEON_SECTION_ROOMS];
+    dungeon->numMainRooms = (int)header->sections[DUNGEON_SECTION_MAIN_ROOMS].count;
+    dungeon->mainRoomIndices = (int *)sections[DUNGEON_SECTION_MAIN_ROOMS];
+    dungeon->numHallways = (int)header->sections[DUNGEON_SECTION_HALLWAYS].count;
+    dungeon->hallways = (hallway_t *)sections[DUNGEON_SECTION_HALLWAYS];
+    dungeon->numSegments = (int)header->sections[DUNGEON_SECTION_SEGMENTS].count;
+    dungeon->segments = (segment_t *)sections[DUNGEON_SECTION_SEGMENTS];
+    dungeon->numCrossings = (int)header->sections[DUNGEON_SECTION_CROSSINGS].count;
+    dungeon->crossings = (crossing_t *)sections[DUNGEON_SECTION_CROSSINGS];
+    dungeon->numDoors = (int)header->sections[DUNGEON_SECTION_DOORS].count;
+    dungeon->doors = (door_t *)sections[DUNGEON_SECTION_DOORS];
+    map->mst_dela.dela_edges = (int)header->sections[DUNGEON_SECTION_DELAUNAY].count;
+    map->mst_dela.dela = (edge_t *)sections[DUNGEON_SECTION_DELAUNAY];
+    map->mst_dela.mst_edges = (int)header->sections[DUNGEON_SECTION_MST].count;
+    map->mst_dela.mst = (edge_t *)sections[DUNGEON_SECTION_MST];
+    return map;
+}
+
+void closeDungeonFile(dungeon_map_t *map) {
+    munmap(map->base, map->size);
+    free(map);
+}
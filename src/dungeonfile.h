@@ -0,0 +1,83 @@
+/*
+ * Binary dungeon files.
+ *
+ * One file holds one dungeon as it stands after fixRoomEdges: rooms, main
+ * room indices, hallways, segments, crossings, doors and the Delaunay and MST
+ * edges, behind a header with the generation parameters. Every array is a
+ * section of raw structs starting on a DUNGEON_FILE_ALIGN boundary, so a
+ * reader maps the file and uses the arrays in place without parsing anything.
+ * The header records the byte order, the file version and each section's
+ * element size, and a file from a build where any of them differ is refused
+ * instead of misread.
+ *
+ * Include after generate.h.
+ */
+
+#define DUNGEON_FILE_MAGIC   "DGNROOMS"
+#define DUNGEON_FILE_VERSION 1
+#define DUNGEON_FILE_ALIGN   64          // section alignment, a cache line
+#define DUNGEON_FILE_ORDER   0x01020304  // reads back differently on the other byte order
+
+// sections, in file order
+#define DUNGEON_SECTION_ROOMS      0
+#define DUNGEON_SECTION_MAIN_ROOMS 1
+#define DUNGEON_SECTION_HALLWAYS   2
+#define DUNGEON_SECTION_SEGMENTS   3
+#define DUNGEON_SECTION_CROSSINGS  4
+#define DUNGEON_SECTION_DOORS      5
+#define DUNGEON_SECTION_DELAUNAY   6
+#define DUNGEON_SECTION_MST        7
+#define DUNGEON_SECTION_COUNT      8
+
+// Everything that decides a dungeon's layout, fixed width with no padding so
+// it can be compared and hashed byte for byte
+typedef struct {
+    uint64_t seed;
+    int32_t numRooms;
+    int32_t radius;
+    int32_t placement;
+    int32_t mainCriterion;
+    float width[3];      // mean, stddev, min
+    float height[3];
+    float mainRooms[3];  // scale, percentile, maxAspect
+    int32_t maxIters;
+    double pExtra;
+    int32_t routing;
+    int32_t algorithmVersion;
+} dungeon_file_params_t;
+
+typedef struct {
+    uint64_t offset;     // from the start of the file, a multiple of DUNGEON_FILE_ALIGN
+    uint64_t count;
+    uint32_t elemSize;
+    uint32_t reserved;
+} dungeon_file_section_t;
+
+typedef struct {
+    char magic[8];
+    uint32_t byteOrder;  // DUNGEON_FILE_ORDER
+    uint32_t version;
+    uint32_t headerSize;
+    uint32_t numSections;
+    dungeon_file_params_t params;
+    dungeon_file_section_t sections[DUNGEON_SECTION_COUNT];
+} dungeon_file_header_t;
+
+/* Fills out from params, returns 0 for params a file can't describe (a user quantile function) */
+int dungeonFileParams(gen_params_t *params, int useRouting, dungeon_file_params_t *out);
+
+/* Writes the dungeon to path, returns the file size or -1 on an I/O error */
+long writeDungeonFile(const char *path, const dungeon_file_params_t *params, const dungeon_t *dungeon,
+                      const double_edge_t *mst_dela);
+
+typedef struct {
+    dungeon_file_header_t *header;
+    unsigned char *base;
+    size_t size;
+    dungeon_t dungeon;       // arrays point into the mapping and are read only
+    double_edge_t mst_dela;  // same
+} dungeon_map_t;
+
+/* Maps a dungeon file read-only, NULL if it can't be opened or isn't a dungeon file of this build */
+dungeon_map_t *openDungeonFile(const char *path);
+void closeDungeonFile(dungeon_map_t *map);
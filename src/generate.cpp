@@ -8,22 +8,33 @@
 #include <cmath>
 #include <cstdlib>
 #include <cstdio>
-#include <random>
+#include <cstring>
 #include <limits>
 #include <algorithm>
+#include <cstdint>
 #include <omp.h>
 
 #include "generate.h"
+#include "rng.h"
+#include "sampler.h"
+#include "placement.h"
+#include "geometry.h"
+#include "rooms.h"
+#include "arena.h"
 #include "Clarkson-Delaunay.h"
-#include "main.h"
-
-#define MAX_ITERS 10000
-#define P_EXTRA 0.10
-
-// Get random point in a circle of a certain radius
-point_t getRandomPointInCircle(float radius) {
-    float t = 2 * M_PI * ((double)rand() / (double)RAND_MAX);
-    float u = ((double)rand() / (double)RAND_MAX) + ((double)rand() / (double)RAND_MAX);
+#include "spatial.h"
+#include "control.h"
+#include "pool.h"
+
+// rooms whose sizes are sampled together
+#define SIZE_BLOCK 1024
+// rooms per block of the main room compaction
+#define SELECT_BLOCK 4096
+
+// Get random point in a circle of a certain radius, deterministic per (seed, room)
+point_t getRandomPointInCircle(float radius, uint64_t seed, int roomNum) {
+    float t = 2 * M_PI * rngUniform(seed, roomNum, RNG_STREAM_POSITION, 0);
+    float u = rngUniform(seed, roomNum, RNG_STREAM_POSITION, 1) + rngUniform(seed, roomNum, RNG_STREAM_POSITION, 2);
     float r = 0;
     if (u > 1){
         r = 2 - u;
@@ -39,66 +50,84 @@ point_t getRandomPointInCircle(float radius) {
 
 // Move the centers of the rooms away from each other
 // stackoverflow.com/questions/70806500/separation-steering-algorithm-for-separationg-set-of-rectangles/
-void separateRooms(dungeon_t *dungeon) {
-    rectangle_t *rooms = dungeon->rooms;
+// Runs on a structure-of-arrays copy of the rooms, see rooms.h.
+// Every iteration reads the positions it starts with and each room sums its
+// own displacement, its push away from every room it overlaps plus that
+// room's push on it, then all rooms move at once. No room is written by two
+// threads and the sums run in room order, so the result is the same for any
+// thread count. Rooms sitting exactly on top of each other would push each
+// other the same way, the lower index goes up-left and the other down-right.
+int separateRooms(dungeon_t *dungeon) {
+    arena_t *arena = scratchArena();
+    arena_mark_t mark = arenaMark(arena);
+    room_soa_t *soa = roomsToSoA(dungeon->rooms, dungeon->numRooms);
+    float *x = soa->x;
+    float *y = soa->y;
+    float *dx = (float *)arenaAlloc(arena, sizeof(float) * dungeon->numRooms);
+    float *dy = (float *)arenaAlloc(arena, sizeof(float) * dungeon->numRooms);
     int num_iters = 0;
-    while (anyOverlapping(rooms, dungeon->numRooms)) {
-        if (num_iters >= MAX_ITERS) {
-            printf("Did not converge in %d iterations\n", num_iters);
-            return;
+    int converged = 1;
+    while (anyOverlappingSoA(soa)) {
+        if (num_iters >= dungeon->params.maxIters) {
+            if (dungeon->params.verbose)
+                printf("Did not converge in %d iterations\n", num_iters);
+            converged = 0;
+            break;
+        }
+        if (genShouldStop(dungeon->params.control, num_iters)) {
+            if (dungeon->params.verbose)
+                printf("Stopped after %d iterations\n", num_iters);
+            converged = 0;
+            break;
         }
         #pragma omp parallel for
         for (int i = 0; i < dungeon->numRooms; i++) {
+            float moveX = 0;
+            float moveY = 0;
             for (int j = 0; j < dungeon->numRooms; j++) {
-                if (i == j)
+                if (i == j || !soaOverlapping(soa, i, j))
                     continue;
-                if (isOverlapping(rooms, i, j)) {
-                    float step_x = rooms[j].center.x - rooms[i].center.x;
-                    float step_y = rooms[j].center.y - rooms[i].center.y;
-                    float dist = sqrt(pow(step_x, 2) + pow(step_y, 2));
-                    if (round(dist) == 0)
-                        dist = 0.001f;
-                    step_x /= dist;
-                    step_y /= dist;
-                    step_x = round(step_x);
-                    step_y = round(step_y);
-
-                    // I suppose its possible for the centers to be exactly equal.
-                    if (step_x == 0.0f)
-                        step_x = 1.0f;
-                    if (step_y == 0.0f)
-                        step_y = 1.0f;
-
-                    rooms[i].center.x -= step_x;
-                    rooms[i].center.y -= step_y;
-                    rooms[j].center.x += step_x;
-                    rooms[j].center.y += step_y;
+                float from[2] = {x[i], y[i]};
+                float to[2] = {x[j], y[j]};
+                float step[2];
+                float back[2];
+                if (from[0] == to[0] && from[1] == to[1]) {
+                    step[0] = step[1] = (i < j) ? 1 : -1;
+                    back[0] = back[1] = -step[0];
+                }
+                else {
+                    steerStep<float, 2>(from, to, step);
+                    steerStep<float, 2>(to, from, back);
                 }
+                moveX += back[0] - step[0];
+                moveY += back[1] - step[1];
             }
+            dx[i] = moveX;
+            dy[i] = moveY;
+        }
+        #pragma omp parallel for
+        for (int i = 0; i < dungeon->numRooms; i++) {
+            x[i] += dx[i];
+            y[i] += dy[i];
         }
         num_iters += 1;
     }
-    printf("Converged in %d iterations\n", num_iters);
+    if (dungeon->params.verbose && converged)
+        printf("Converged in %d iterations\n", num_iters);
+    roomsFromSoA(soa, dungeon->rooms);
+    arenaRelease(arena, mark);
+    return num_iters;
 }
 
 // Check if two rectangles are overlapping
 int isOverlapping(rectangle_t *rooms, int i1, int i2) {
     if (i1 == i2)
         return 0;
-    float left1 = rooms[i1].center.x - (rooms[i1].width / 2);
-    float right1 = rooms[i1].center.x + (rooms[i1].width / 2);
-    float bottom1 = rooms[i1].center.y + (rooms[i1].height / 2);
-    float top1 = rooms[i1].center.y - (rooms[i1].height / 2);
-
-    float left2 = rooms[i2].center.x - (rooms[i2].width / 2);
-    float right2 = rooms[i2].center.x + (rooms[i2].width / 2);
-    float bottom2 = rooms[i2].center.y + (rooms[i2].height / 2);
-    float top2 = rooms[i2].center.y - (rooms[i2].height / 2);
-    if (right1 < left2 || right2 < left1)
-        return 0;
-    if (bottom1 < top2 || bottom2 < top1)
-        return 0;
-    return 1;
+    float center1[2] = {rooms[i1].center.x, rooms[i1].center.y};
+    float half1[2] = {rooms[i1].width / 2, rooms[i1].height / 2};
+    float center2[2] = {rooms[i2].center.x, rooms[i2].center.y};
+    float half2[2] = {rooms[i2].width / 2, rooms[i2].height / 2};
+    return boxesOverlap<float, 2>(center1, half1, center2, half2);
 }
 
 // Check if a rectangle is overlapping any others
@@ -124,8 +153,23 @@ int findSubset(int a, int *parentMap) {
     return findSubset(parentMap[a], parentMap);
 }
 
+// Marks the undirected edge src-dest in an open addressed set of room pairs,
+// returns 0 if it was already marked
+static int markPair(uint64_t *slots, uint64_t mask, int src, int dest) {
+    // pair + 1 so that an empty slot (0) is never a pair
+    uint64_t pair = (((uint64_t)std::min(src, dest) << 32) | (uint32_t)std::max(src, dest)) + 1;
+    for (uint64_t i = splitmix64(pair) & mask; ; i = (i + 1) & mask) {
+        if (slots[i] == pair)
+            return 0;
+        if (slots[i] == 0) {
+            slots[i] = pair;
+            return 1;
+        }
+    }
+}
+
 // Return list of (unnecessarily directed) edges that form minimum spanning tree
-edge_t *findMinimumSpanningTree(edge_t *allEdges, int numMainRooms, int numVertices, int numEdges, float pExtras, int *numAddedEdges_p) {
+edge_t *findMinimumSpanningTree(edge_t *allEdges, int numVertices, int numEdges, float pExtras, uint64_t seed, int *numAddedEdges_p) {
     if (pExtras < 0.0f || pExtras > 1.0f)
         pExtras = 0.0f;
 
@@ -134,10 +178,15 @@ edge_t *findMinimumSpanningTree(edge_t *allEdges, int numMainRooms, int numVerti
     int numAddedEdges = 0;  // Total number of edges to use in the dungeon
     int numSpanningEdges = 0;  // Number of edges that form the MST
     edge_t *mst = (edge_t *)calloc(numEdges, sizeof(edge_t));
-    int *parentMap = (int *)malloc(sizeof(int) * numVertices);
+    arena_t *arena = scratchArena();
+    arena_mark_t mark = arenaMark(arena);
+    int *parentMap = (int *)arenaAlloc(arena, sizeof(int) * numVertices);
 
-    // Structure for checking if an edge has already been added
-    int *adjMatrix = (int*)calloc(numEdges * numEdges, sizeof(int));
+    // Edges already added as room pairs, at most half full
+    uint64_t numSlots = 1;
+    while (numSlots < 2 * (uint64_t)numEdges)
+        numSlots *= 2;
+    uint64_t *added = (uint64_t *)arenaCalloc(arena, numSlots, sizeof(uint64_t));
 
     // Initialize the union find thing
     for (int i = 0; i < numVertices; i++) {
@@ -146,86 +195,180 @@ edge_t *findMinimumSpanningTree(edge_t *allEdges, int numMainRooms, int numVerti
     for (int i = 0; i < numEdges; i++) {
         int src = allEdges[i].src;
         int dest = allEdges[i].dest;
-        if (adjMatrix[dest + numEdges * src] || adjMatrix[src + numEdges * dest])
-            continue;
         int parentSrc = findSubset(src, parentMap);
         int parentDest = findSubset(dest, parentMap);
         if (parentSrc == parentDest) {
             // Chance of adding an extra edge
-            float roll = (double)rand() / (double)RAND_MAX;
-            if (roll < pExtras) {
+            float roll = rngUniform(seed, i, RNG_STREAM_EXTRA_EDGE, 0);
+            if (roll < pExtras && markPair(added, numSlots - 1, src, dest)) {
                 mst[numAddedEdges] = {src, dest, allEdges[i].dist};
                 numAddedEdges += 1;
-                adjMatrix[dest + numEdges * src] = 1;
-                adjMatrix[src + numEdges * dest] = 1;
             }
             continue;
         }
         mst[numAddedEdges] = {src, dest, allEdges[i].dist};
-        adjMatrix[dest + numEdges * src] = 1;
-        adjMatrix[src + numEdges * dest] = 1;
+        markPair(added, numSlots - 1, src, dest);
         numAddedEdges += 1;
         numSpanningEdges += 1;
         parentMap[parentDest] = parentSrc;
     }
     *numAddedEdges_p = numAddedEdges;
-    free(parentMap);
-    free(adjMatrix);
+    arenaRelease(arena, mark);
     return mst;
 }
 
+void defaultGenParams(gen_params_t *params) {
+    params->numRooms = 0;
+    params->radius = 25;
+    params->placement = PLACEMENT_DISC;
+    params->seed = 100;
+    params->verbose = 1;
+    size_distribution_t size = {10, 10, 3, NULL};
+    params->width = size;
+    params->height = size;
+    main_room_params_t mainRooms = {MAIN_ROOM_SIZE, 1.25f, 0, 0};
+    params->mainRooms = mainRooms;
+    params->maxIters = MAX_ITERS;
+    params->pExtra = P_EXTRA;
+    params->control = NULL;
+}
+
 /*
- * Top function of sequential algorithm, called by main in main.cpp
+ * Main rooms are picked by stream compaction: each fixed-size block counts
+ * the rooms that pass the predicate, an exclusive prefix sum over the block
+ * counts gives every block its first output slot, and the blocks then write
+ * their indices in order. The blocks don't depend on the thread count, and
+ * the output is sorted because the blocks are written in room order.
  */
-void generate(dungeon_t *dungeon, int numRooms, int radius) {
-    int mean_width = 10;
-    float min_width = 3;
-    int stddev_width = 10;
+void selectMainRooms(dungeon_t *dungeon, main_room_params_t *criteria) {
+    rectangle_t *rooms = dungeon->rooms;
+    int numRooms = dungeon->numRooms;
+    float minWidth = criteria->scale * dungeon->params.width.mean;
+    float minHeight = criteria->scale * dungeon->params.height.mean;
+
+    arena_t *arena = scratchArena();
+    arena_mark_t mark = arenaMark(arena);
+
+    // area at the percentile, sizes are whole tiles so the areas are exact
+    float minArea = 0;
+    if (criteria->criterion == MAIN_ROOM_AREA && numRooms > 0) {
+        float *areas = (float *)arenaAlloc(arena, sizeof(float) * numRooms);
+        #pragma omp parallel for schedule(static)
+        for (int i = 0; i < numRooms; i++)
+            areas[i] = rooms[i].width * rooms[i].height;
+        float p = std::min(std::max(criteria->percentile, 0.0f), 100.0f);
+        int rank = (int)(p / 100 * (numRooms - 1));
+        std::nth_element(areas, areas + rank, areas + numRooms);
+        minArea = areas[rank];
+    }
+
+    char *isMain = (char *)arenaAlloc(arena, numRooms);
+    int numBlocks = (numRooms + SELECT_BLOCK - 1) / SELECT_BLOCK;
+    int *blockStart = (int *)arenaAlloc(arena, sizeof(int) * (numBlocks + 1));
+    #pragma omp parallel for schedule(static)
+    for (int b = 0; b < numBlocks; b++) {
+        int end = std::min((b + 1) * SELECT_BLOCK, numRooms);
+        int count = 0;
+        for (int i = b * SELECT_BLOCK; i < end; i++) {
+            float w = rooms[i].width;
+            float h = rooms[i].height;
+            int pass;
+            if (criteria->criterion == MAIN_ROOM_AREA)
+                pass = w * h >= minArea;
+            else
+                pass = w > minWidth && h > minHeight;
+            if (criteria->maxAspect > 0 && std::max(w, h) > criteria->maxAspect * std::min(w, h))
+                pass = 0;
+            isMain[i] = pass;
+            count += pass;
+        }
+        blockStart[b + 1] = count;
+    }
+
+    blockStart[0] = 0;
+    for (int b = 0; b < numBlocks; b++)
+        blockStart[b + 1] += blockStart[b];
+    int numMain = blockStart[numBlocks];
+
+    int *mainRoomIndices = (int *)malloc(sizeof(int) * (numMain > 0 ? numMain : 1));
+    #pragma omp parallel for schedule(static)
+    for (int b = 0; b < numBlocks; b++) {
+        int end = std::min((b + 1) * SELECT_BLOCK, numRooms);
+        int out = blockStart[b];
+        for (int i = b * SELECT_BLOCK; i < end; i++) {
+            if (isMain[i])
+                mainRoomIndices[out++] = i;
+        }
+    }
+    arenaRelease(arena, mark);
 
-    int mean_height = 10;
-    float min_height = 3;
-    int stddev_height = 10;
+    dungeon->mainRoomIndices = mainRoomIndices;
+    dungeon->numMainRooms = numMain;
+}
 
-    srand(100);
-    std::default_random_engine generator;
-    std::normal_distribution<float> width_distribution(mean_width, stddev_width);
-    std::normal_distribution<float> height_distribution(mean_height, stddev_height);
+/*
+ * Top function of sequential algorithm, called by main in main.cpp
+ *
+ * Every random number comes from the counter-based generator keyed on
+ * (seed, room index, stream), so the rooms are created in parallel and the
+ * result does not depend on the thread count.
+ */
+void generate(dungeon_t *dungeon, gen_params_t *params) {
+    int numRooms = params->numRooms;
+    uint64_t seed = params->seed;
 
     // create data structures
     rectangle_t *rooms = (rectangle_t *)calloc(numRooms, sizeof(rectangle_t));
-    rectangle_t *mainRooms = (rectangle_t *)malloc(sizeof(rectangle_t) * numRooms);
+    dungeon->params = *params;
     dungeon->rooms = rooms;
     dungeon->numRooms = numRooms;
-
-    // generate list of rooms, add each to 1-d list
-    int main_index = 0;
-    int *mainIndexToIndex = (int *)calloc(numRooms, sizeof(int));
-    for (int i = 0; i < numRooms; i++) {
-        point_t center = getRandomPointInCircle(radius);
-        rooms[i].center = center;
-        while (rooms[i].width < min_width) {
-            rooms[i].width = round(width_distribution(generator));
-        }
-        while (rooms[i].height < min_height) {
-            rooms[i].height = round(height_distribution(generator));
-        }
-        if (rooms[i].width > 1.25 * mean_width && rooms[i].height > 1.25 * mean_height) {
-            mainRooms[main_index] = rooms[i];
-            mainIndexToIndex[main_index] = i;
-            main_index += 1;
+    dungeon->numHallways = 0;
+    dungeon->hallways = NULL;
+    dungeon->numSegments = 0;
+    dungeon->segments = NULL;
+    dungeon->numCrossings = 0;
+    dungeon->crossings = NULL;
+    dungeon->numDoors = 0;
+    dungeon->doors = NULL;
+
+    arena_t *arena = scratchArena();
+    arena_mark_t mark = arenaMark(arena);
+    size_table_t *widthTable = (size_table_t *)arenaAlloc(arena, sizeof(size_table_t));
+    size_table_t *heightTable = (size_table_t *)arenaAlloc(arena, sizeof(size_table_t));
+    buildSizeTable(&params->width, widthTable);
+    buildSizeTable(&params->height, heightTable);
+
+    // generate list of rooms, add each to 1-d list, sizes are sampled a block at a time
+    // and the centers placed afterwards, since the placement can depend on the sizes
+    int numBlocks = (numRooms + SIZE_BLOCK - 1) / SIZE_BLOCK;
+    #pragma omp parallel for schedule(static)
+    for (int b = 0; b < numBlocks; b++) {
+        float widths[SIZE_BLOCK];
+        float heights[SIZE_BLOCK];
+        int begin = b * SIZE_BLOCK;
+        int count = std::min(SIZE_BLOCK, numRooms - begin);
+        sampleSizes(widthTable, seed, RNG_STREAM_WIDTH, begin, count, widths);
+        sampleSizes(heightTable, seed, RNG_STREAM_HEIGHT, begin, count, heights);
+        for (int k = 0; k < count; k++) {
+            rooms[begin + k].width = widths[k];
+            rooms[begin + k].height = heights[k];
         }
     }
-    printf("There are %d main rooms\n", main_index);
-    dungeon->mainRoomIndices = mainIndexToIndex;
-    dungeon->numMainRooms = main_index;
-    free(mainRooms);
+    arenaRelease(arena, mark);
+    placeRooms(params, rooms, numRooms);
+
+    selectMainRooms(dungeon, &params->mainRooms);
+    if (params->verbose)
+        printf("There are %d main rooms\n", dungeon->numMainRooms);
 }
 
 double_edge_t* constructHallways(dungeon_t *dungeon) {
     rectangle_t *rooms = dungeon->rooms;
 
     // Get center points of main rooms
-    float *pointList = (float *)calloc(dungeon->numMainRooms * 2, sizeof(float));
+    arena_t *arena = scratchArena();
+    arena_mark_t mark = arenaMark(arena);
+    float *pointList = (float *)arenaAlloc(arena, sizeof(float) * dungeon->numMainRooms * 2);
     for (int i = 0; i < dungeon->numMainRooms; i++) {
         pointList[i * 2] = dungeon->rooms[dungeon->mainRoomIndices[i]].center.x;
         pointList[i * 2 + 1] = dungeon->rooms[dungeon->mainRoomIndices[i]].center.y;
@@ -241,6 +384,9 @@ double_edge_t* constructHallways(dungeon_t *dungeon) {
             2,
             0,
             &numTriangleVertices);
+    // a cancelled generation gets no MST and no hallways
+    if (genCancelled(dungeon->params.control))
+        numTriangleVertices = 0;
 
     // Construct directed edges
     edge_t *allEdges = (edge_t *)calloc(numTriangleVertices * 2, sizeof(edge_t));
@@ -249,7 +395,8 @@ double_edge_t* constructHallways(dungeon_t *dungeon) {
 
     int triangleCounter = 0;
     int vertices[3];
-    printf("numTriangleVertices mod 3: %d\n", (numTriangleVertices % 3));
+    if (dungeon->params.verbose)
+        printf("numTriangleVertices mod 3: %d\n", (numTriangleVertices % 3));
 
     int edge_index = 0;
     for (int i = 0; i < numTriangleVertices; i++) {
@@ -275,7 +422,7 @@ double_edge_t* constructHallways(dungeon_t *dungeon) {
 
     // Find MST + a few extra edges
     int numAddedEdges = 0;
-    edge_t *mst = findMinimumSpanningTree(allEdges, dungeon->numMainRooms, dungeon->numRooms, edge_index, P_EXTRA, &numAddedEdges);
+    edge_t *mst = findMinimumSpanningTree(allEdges, dungeon->numRooms, edge_index, dungeon->params.pExtra, dungeon->params.seed, &numAddedEdges);
     // for (int i = 0; i < numAddedEdges; i++) {
     //     printf("src: %d, dest: %d\n", mst[i].src, mst[i].dest);
     // }
@@ -286,26 +433,17 @@ double_edge_t* constructHallways(dungeon_t *dungeon) {
         rectangle_t src_room = rooms[mst[i].src];
         rectangle_t dest_room = rooms[mst[i].dest];
 
-        float src_left = round(src_room.center.x - (src_room.width / 2));
-        float src_right = round(src_room.center.x + (src_room.width / 2));
-        float src_top = round(src_room.center.y - (src_room.height / 2));
-        float src_bottom = round(src_room.center.y + (src_room.height / 2));
+        // Straight when the rooms' floor tile spans share the midpoint column or row
+        float mid_x, mid_y;
+        bool straight_x = sharedSpan<float>(src_room.center.x, src_room.width, dest_room.center.x, dest_room.width, &mid_x);
+        bool straight_y = sharedSpan<float>(src_room.center.y, src_room.height, dest_room.center.y, dest_room.height, &mid_y);
 
-        float dest_left = round(dest_room.center.x - (dest_room.width / 2));
-        float dest_right = round(dest_room.center.x + (dest_room.width / 2));
-        float dest_top = round(dest_room.center.y - (dest_room.height / 2));
-        float dest_bottom = round(dest_room.center.y + (dest_room.height / 2));
-
-        // Some are going to be duplicates due to directed graph and due to triangle construction, need to remove
-        float mid_x = ((src_room.center.x + dest_room.center.x) / 2);
-        float mid_y = round((src_room.center.y + dest_room.center.y) / 2);
-
-        if (src_left < mid_x && mid_x < src_right && dest_left < mid_x && mid_x < dest_right) {
+        if (straight_x) {
             hallways[i].start = {mid_x, src_room.center.y};
             hallways[i].middle = {mid_x, dest_room.center.y};
             hallways[i].end = {mid_x, dest_room.center.y};
         }
-        else if (src_top < mid_y && mid_y < src_bottom && dest_top < mid_y && mid_y < dest_bottom) {
+        else if (straight_y) {
             hallways[i].start = {src_room.center.x, mid_y};
             hallways[i].middle = {dest_room.center.x, mid_y};
             hallways[i].end = {dest_room.center.x, mid_y};
@@ -317,10 +455,19 @@ double_edge_t* constructHallways(dungeon_t *dungeon) {
         }
     }
 
+    // Split hallways into their two straight pieces for the spatial stages
+    segment_t *segments = (segment_t *)calloc(numAddedEdges, 2 * sizeof(segment_t));
+    for (int i = 0; i < numAddedEdges; i++) {
+        segments[i * 2] = {hallways[i].start, hallways[i].middle, i};
+        segments[i * 2 + 1] = {hallways[i].middle, hallways[i].end, i};
+    }
+
     dungeon->hallways = hallways;
     dungeon->numHallways = numAddedEdges;
+    dungeon->segments = segments;
+    dungeon->numSegments = numAddedEdges * 2;
 
-    free(pointList);
+    arenaRelease(arena, mark);
     free(triangleIndexList);
     // free(allEdges);
     // free(mst);
@@ -361,22 +508,23 @@ int checkBounds(float topLeftx, float topLefty, float botRightx, float botRighty
 }
 
 // function to find set of non-main rooms that overlap with hallways.
-// MainRoomIndices array is ordered, can use that to avoid O(n) lookup
-void getIncludedRooms(dungeon_t* dungeon) {
-    //printf("***************************************************\n");
-    
+// MainRoomIndices array is ordered, can use that to avoid O(n) lookup.
+// Sequential reference for getIncludedRooms, kept for verification: every
+// room is tested against every segment, O(rooms x segments), without the
+// segment grid or the bitmap the parallel version relies on. Segments rather
+// than hallways, since routed dungeons have no L-shaped hallways.
+void getIncludedRoomsSequential(dungeon_t* dungeon) {
     int mainRoomIndex = 0;
     for (int roomNum = 0; roomNum < dungeon->numRooms; roomNum++) {
         // check if next main room
         // can be done since main room index array is ordered, O(1) vs O(n)
-        if (roomNum == dungeon->mainRoomIndices[mainRoomIndex]) {
+        if (mainRoomIndex < dungeon->numMainRooms && roomNum == dungeon->mainRoomIndices[mainRoomIndex]) {
             mainRoomIndex++;
             // setting bit to be included
             dungeon->rooms[roomNum].status += BIT_INCLUDED;
             dungeon->rooms[roomNum].status += BIT_MAINROOM;
             continue;
         }
-        //printf("checking halls for room %d\n", roomNum);
 
         float topLeftx = dungeon->rooms[roomNum].center.x - dungeon->rooms[roomNum].width/2;
         float topLefty = dungeon->rooms[roomNum].center.y - dungeon->rooms[roomNum].height/2;
@@ -385,32 +533,249 @@ void getIncludedRooms(dungeon_t* dungeon) {
         
         dungeon->rooms[roomNum].status = 0;
 
-        // looping over all hallways
-        for (int hallwayNum = 0; hallwayNum < dungeon->numHallways; hallwayNum++) {
-            hallway_t* hall = &dungeon->hallways[hallwayNum];
-
-            // check if room is within bounds of hallway, either of two edges
-            // two conditions for each
+        // looping over all hallway segments
+        for (int segNum = 0; segNum < dungeon->numSegments; segNum++) {
+            segment_t* seg = &dungeon->segments[segNum];
 
-            // start --> middle
-            if (checkBounds(topLeftx, topLefty, botRightx, botRighty, &hall->start, &hall->middle)) {
+            // check if room is within bounds of the segment
+            if (checkBounds(topLeftx, topLefty, botRightx, botRighty, &seg->start, &seg->end)) {
                 dungeon->rooms[roomNum].status += BIT_INCLUDED;
-                //printf("%d\n",hallwayNum);
                 break;
             }
+        }
+    }
+}
 
-            if (checkBounds(topLeftx, topLefty, botRightx, botRighty, &hall->middle, &hall->end)) {
-                // included could already be set
-                if (!(dungeon->rooms[roomNum].status & BIT_INCLUDED))
-                    dungeon->rooms[roomNum].status += BIT_INCLUDED;
-                //printf("%d\n",hallwayNum);
-                break;
-            }
+int verifyIncludedRooms(dungeon_t* dungeon) {
+    arena_t *arena = scratchArena();
+    arena_mark_t mark = arenaMark(arena);
+    dungeon_t reference = *dungeon;
+    reference.rooms = (rectangle_t *)arenaAlloc(arena, sizeof(rectangle_t) * dungeon->numRooms);
+    for (int i = 0; i < dungeon->numRooms; i++) {
+        reference.rooms[i] = dungeon->rooms[i];
+        reference.rooms[i].status = 0;
+    }
+    getIncludedRoomsSequential(&reference);
+
+    // fixRoomEdges has set the edge bits since, only inclusion is compared
+    int mismatches = 0;
+    for (int i = 0; i < dungeon->numRooms; i++) {
+        if ((reference.rooms[i].status ^ dungeon->rooms[i].status) & (BIT_INCLUDED | BIT_MAINROOM))
+            mismatches++;
+    }
+    arenaRelease(arena, mark);
+    return mismatches;
+}
+
+// Branch-free checkBounds over the entries [begin, end) of a grid cell.
+// Comparisons are combined with bitwise ops so the loop vectorizes.
+static int anySegmentInBounds(segment_grid_t *grid, int begin, int end,
+                              float topLeftx, float topLefty, float botRightx, float botRighty) {
+    const float *loX = grid->loX;
+    const float *loY = grid->loY;
+    const float *hiX = grid->hiX;
+    const float *hiY = grid->hiY;
+    int hit = 0;
+    #pragma omp simd reduction(|:hit)
+    for (int k = begin; k < end; k++) {
+        int vertical = (loX[k] == hiX[k]) & (loY[k] != hiY[k]);
+        int horizontal = (loY[k] == hiY[k]) & (loX[k] != hiX[k]);
+        int vHit = vertical & (loX[k] > topLeftx) & (loX[k] < botRightx)
+                 & (((topLefty > loY[k]) & (topLefty < hiY[k])) | ((botRighty > loY[k]) & (botRighty < hiY[k])));
+        int hHit = horizontal & (loY[k] > topLefty) & (loY[k] < botRighty)
+                 & (((topLeftx > loX[k]) & (topLeftx < hiX[k])) | ((botRightx > loX[k]) & (botRightx < hiX[k])));
+        hit |= vHit | hHit;
+    }
+    return hit;
+}
+
+// Parallel version of getIncludedRooms. Main room membership comes from a
+// bitmap instead of the sorted cursor so rooms can be split across threads.
+void getIncludedRooms(dungeon_t* dungeon) {
+    arena_t *arena = scratchArena();
+    arena_mark_t mark = arenaMark(arena);
+    segment_grid_t *grid = buildSegmentGrid(dungeon->segments, dungeon->numSegments);
+
+    int numWords = (dungeon->numRooms + 63) / 64;
+    uint64_t *mainBitmap = (uint64_t *)arenaCalloc(arena, numWords, sizeof(uint64_t));
+    for (int i = 0; i < dungeon->numMainRooms; i++) {
+        int roomNum = dungeon->mainRoomIndices[i];
+        mainBitmap[roomNum / 64] |= (uint64_t)1 << (roomNum % 64);
+    }
+
+    rectangle_t *rooms = dungeon->rooms;
+    gen_control_t *control = dungeon->params.control;
+    parallelFor(0, dungeon->numRooms, 256, [&](int roomNum) {
+        if ((mainBitmap[roomNum / 64] >> (roomNum % 64)) & 1) {
+            rooms[roomNum].status += BIT_INCLUDED;
+            rooms[roomNum].status += BIT_MAINROOM;
+            return;
         }
+        if (genCancelled(control))
+            return;
 
-        // if (dungeon->rooms[roomNum].include == 0)
-        //     printf("no intersections found for %d\n", roomNum);
-        
+        float topLeftx = rooms[roomNum].center.x - rooms[roomNum].width/2;
+        float topLefty = rooms[roomNum].center.y - rooms[roomNum].height/2;
+        float botRightx = rooms[roomNum].center.x + rooms[roomNum].width/2;
+        float botRighty = rooms[roomNum].center.y + rooms[roomNum].height/2;
+
+        rooms[roomNum].status = 0;
+
+        int col0, row0, col1, row1;
+        if (!segmentGridCellRange(grid, topLeftx, topLefty, botRightx, botRighty, &col0, &row0, &col1, &row1))
+            return;
+
+        int found = 0;
+        for (int row = row0; row <= row1 && !found; row++) {
+            // cells of one row are adjacent in the entry arrays, test them as one batch
+            int begin = grid->cellStart[row * grid->cols + col0];
+            int end = grid->cellStart[row * grid->cols + col1 + 1];
+            found = anySegmentInBounds(grid, begin, end, topLeftx, topLefty, botRightx, botRighty);
+        }
+        if (found)
+            rooms[roomNum].status += BIT_INCLUDED;
+    });
+
+    arenaRelease(arena, mark);
+}
+
+// Doors are written to dungeon files and the cache as raw structs, so the
+// padding after side is zeroed too, or the files differ from run to run
+static void setDoor(door_t *door, float x, float y, int roomNum, char side) {
+    memset(door, 0, sizeof(door_t));
+    door->at.x = x;
+    door->at.y = y;
+    door->room = roomNum;
+    door->side = side;
+}
+
+// Finds where a hallway segment passes through the walls of a room and
+// writes a door for each wall it crosses, at most two, returns how many.
+// Segments running along a wall do not cut it.
+static int checkEdge(float topLeftx, float topLefty, float botRightx, float botRighty,
+                     segment_t *seg, int roomNum, door_t *doors) {
+    float lowx = std::min(seg->start.x, seg->end.x);
+    float highx = std::max(seg->start.x, seg->end.x);
+    float lowy = std::min(seg->start.y, seg->end.y);
+    float highy = std::max(seg->start.y, seg->end.y);
+
+    int n = 0;
+    if (lowx == highx && lowy != highy && lowx > topLeftx && lowx < botRightx) {
+        if (lowy <= topLefty && topLefty <= highy)
+            setDoor(&doors[n++], lowx, topLefty, roomNum, BIT_NO_T_EDGE);
+        if (lowy <= botRighty && botRighty <= highy)
+            setDoor(&doors[n++], lowx, botRighty, roomNum, BIT_NO_B_EDGE);
+    }
+    if (lowy == highy && lowx != highx && lowy > topLefty && lowy < botRighty) {
+        if (lowx <= topLeftx && topLeftx <= highx)
+            setDoor(&doors[n++], topLeftx, lowy, roomNum, BIT_NO_L_EDGE);
+        if (lowx <= botRightx && botRightx <= highx)
+            setDoor(&doors[n++], botRightx, lowy, roomNum, BIT_NO_R_EDGE);
+    }
+    return n;
+}
+
+static bool doorLT(const door_t &a, const door_t &b) {
+    if (a.side != b.side)
+        return a.side < b.side;
+    if (a.at.x != b.at.x)
+        return a.at.x < b.at.x;
+    return a.at.y < b.at.y;
+}
+
+static bool doorEQ(const door_t &a, const door_t &b) {
+    return a.side == b.side && a.at.x == b.at.x && a.at.y == b.at.y;
+}
+
+// Grid cell range under an included room, 0 if the room needs no doors
+static int roomCells(dungeon_t *dungeon, segment_grid_t *grid, int roomNum, int *col0, int *row0, int *col1, int *row1) {
+    rectangle_t *room = &dungeon->rooms[roomNum];
+    if (!(room->status & BIT_INCLUDED) || genCancelled(dungeon->params.control))
+        return 0;
+    return segmentGridCellRange(grid, room->center.x - room->width/2, room->center.y - room->height/2,
+                                room->center.x + room->width/2, room->center.y + room->height/2,
+                                col0, row0, col1, row1);
+}
+
+// Knocks doors into the walls of included rooms where hallways touch them.
+// Sets the BIT_NO_*_EDGE bits and fills doors / numDoors in room order.
+// A first pass counts the grid entries under each room, which bounds its
+// candidate segments and, two per segment, its doors, so every room gets
+// its own slice of one arena buffer and the rooms are independent.
+void fixRoomEdges(dungeon_t* dungeon) {
+    arena_t *arena = scratchArena();
+    arena_mark_t mark = arenaMark(arena);
+    segment_grid_t *grid = buildSegmentGrid(dungeon->segments, dungeon->numSegments);
+    int numRooms = dungeon->numRooms;
+    int *roomStart = (int *)arenaAlloc(arena, sizeof(int) * (numRooms + 1));
+    int *roomDoors = (int *)arenaAlloc(arena, sizeof(int) * numRooms);
+
+    roomStart[0] = 0;
+    parallelFor(0, numRooms, 256, [&](int roomNum) {
+        int col0, row0, col1, row1;
+        int entries = 0;
+        if (roomCells(dungeon, grid, roomNum, &col0, &row0, &col1, &row1)) {
+            for (int row = row0; row <= row1; row++)
+                entries += grid->cellStart[row * grid->cols + col1 + 1] - grid->cellStart[row * grid->cols + col0];
+        }
+        roomStart[roomNum + 1] = entries;
+    });
+    for (int roomNum = 0; roomNum < numRooms; roomNum++)
+        roomStart[roomNum + 1] += roomStart[roomNum];
+    int *candidateBuffer = (int *)arenaAlloc(arena, sizeof(int) * roomStart[numRooms]);
+    door_t *doorBuffer = (door_t *)arenaAlloc(arena, sizeof(door_t) * 2 * roomStart[numRooms]);
+
+    // included rooms are sparse and their cost varies, so this is left to stealing
+    parallelFor(0, numRooms, 64, [&](int roomNum) {
+        roomDoors[roomNum] = 0;
+        int col0, row0, col1, row1;
+        if (roomStart[roomNum + 1] == roomStart[roomNum] ||
+            !roomCells(dungeon, grid, roomNum, &col0, &row0, &col1, &row1))
+            return;
+        rectangle_t *room = &dungeon->rooms[roomNum];
+        float topLeftx = room->center.x - room->width/2;
+        float topLefty = room->center.y - room->height/2;
+        float botRightx = room->center.x + room->width/2;
+        float botRighty = room->center.y + room->height/2;
+
+        // long segments are listed in several cells, visit each once
+        int *candidates = candidateBuffer + roomStart[roomNum];
+        int numCandidates = 0;
+        for (int row = row0; row <= row1; row++) {
+            int begin = grid->cellStart[row * grid->cols + col0];
+            int end = grid->cellStart[row * grid->cols + col1 + 1];
+            for (int k = begin; k < end; k++)
+                candidates[numCandidates++] = grid->cellSegments[k];
+        }
+        std::sort(candidates, candidates + numCandidates);
+        numCandidates = (int)(std::unique(candidates, candidates + numCandidates) - candidates);
+
+        door_t *doors = doorBuffer + 2 * roomStart[roomNum];
+        int numDoors = 0;
+        for (int k = 0; k < numCandidates; k++)
+            numDoors += checkEdge(topLeftx, topLefty, botRightx, botRighty, &dungeon->segments[candidates[k]],
+                                  roomNum, doors + numDoors);
+
+        // segments meeting end to end on a wall would give the same door twice
+        std::sort(doors, doors + numDoors, doorLT);
+        numDoors = (int)(std::unique(doors, doors + numDoors, doorEQ) - doors);
+        for (int k = 0; k < numDoors; k++)
+            room->status |= doors[k].side;
+        roomDoors[roomNum] = numDoors;
+    });
+
+    int numDoors = 0;
+    for (int roomNum = 0; roomNum < numRooms; roomNum++)
+        numDoors += roomDoors[roomNum];
+    door_t *doors = (door_t *)malloc(sizeof(door_t) * (numDoors > 0 ? numDoors : 1));
+    int d = 0;
+    for (int roomNum = 0; roomNum < numRooms; roomNum++) {
+        std::copy(doorBuffer + 2 * roomStart[roomNum], doorBuffer + 2 * roomStart[roomNum] + roomDoors[roomNum], doors + d);
+        d += roomDoors[roomNum];
     }
-    // printf("***************************************************\n");
+
+    free(dungeon->doors);
+    dungeon->doors = doors;
+    dungeon->numDoors = numDoors;
+    arenaRelease(arena, mark);
 }
@@ -1,3 +1,20 @@
+#include <cstdint>
+
+// defaults for gen_params_t maxIters and pExtra
+#define MAX_ITERS 10000  // separation iterations before giving up
+#define P_EXTRA 0.10f    // chance that a Delaunay edge outside the MST becomes a hallway
+
+// Bump whenever a stage changes the dungeon it produces for the same params,
+// so cached dungeons from older builds are not reused
+#define DUNGEON_ALGORITHM_VERSION 3
+
+// rectangle_t status bits
+#define BIT_INCLUDED  (1 << 0)
+#define BIT_MAINROOM  (1 << 1)
+#define BIT_NO_B_EDGE (1 << 2)
+#define BIT_NO_T_EDGE (1 << 3)
+#define BIT_NO_L_EDGE (1 << 4)
+#define BIT_NO_R_EDGE (1 << 5)
 
 typedef struct {
     float x;
@@ -17,19 +34,91 @@ typedef struct {
     char status;
 } rectangle_t;
 
+// L-shaped hallway from constructHallways, routed dungeons have none (see routing.h)
 typedef struct {
     point_t start;
     point_t middle;
     point_t end;
 } hallway_t;
 
+// One straight piece of a hallway, start --> middle or middle --> end
+typedef struct {
+    point_t start;
+    point_t end;
+    int hallway;
+} segment_t;
+
+// Point where a horizontal and a vertical hallway segment meet
+typedef struct {
+    point_t at;
+    int horizontal;  // index into segments
+    int vertical;    // index into segments
+} crossing_t;
+
+// Gap knocked into a room wall where a hallway passes through it
+typedef struct {
+    point_t at;
+    int room;
+    char side;       // BIT_NO_*_EDGE bit of the wall
+} door_t;
+
+// initial room placements
+#define PLACEMENT_DISC     0
+#define PLACEMENT_JITTERED 1
+#define PLACEMENT_POISSON  2
+
+// Distribution of room widths or heights. Sizes are rounded to whole tiles
+// and never come out below min.
+typedef struct {
+    float mean;
+    float stddev;
+    float min;
+    float (*quantile)(float u);  // optional inverse CDF on (0, 1), replaces the normal when set
+} size_distribution_t;
+
+// main room criteria
+#define MAIN_ROOM_SIZE 0  // width and height both above scale times their means
+#define MAIN_ROOM_AREA 1  // area at or above the given percentile of all room areas
+
+// Which rooms become main rooms. maxAspect applies on top of either criterion.
+typedef struct {
+    int criterion;     // MAIN_ROOM_*
+    float scale;       // MAIN_ROOM_SIZE threshold over the mean sizes
+    float percentile;  // MAIN_ROOM_AREA threshold in [0, 100]
+    float maxAspect;   // longer side over shorter side at most this, 0 for no limit
+} main_room_params_t;
+
+struct gen_control_t;
+
+// Everything generate needs to reproduce a dungeon
 typedef struct {
+    int numRooms;
+    int radius;                  // disc the rooms start in, <= 0 sizes it to the room area
+    int placement;               // PLACEMENT_* initial room placement, see placement.h
+    uint64_t seed;
+    size_distribution_t width;
+    size_distribution_t height;
+    main_room_params_t mainRooms;
+    int maxIters;                // separation iterations before giving up, MAX_ITERS by default
+    float pExtra;                // chance a non-MST Delaunay edge becomes a hallway, P_EXTRA by default
+    int verbose;                 // print progress from the stages
+    struct gen_control_t *control;  // progress and early stop, NULL for none, see control.h
+} gen_params_t;
+
+typedef struct {
+    gen_params_t params;
     int numRooms;
     int numMainRooms;
     int numHallways;
     rectangle_t *rooms;
     int *mainRoomIndices;
     hallway_t *hallways;
+    int numSegments;
+    segment_t *segments;
+    int numCrossings;
+    crossing_t *crossings;
+    int numDoors;
+    door_t *doors;
 } dungeon_t;
 
 typedef struct {
@@ -39,18 +128,38 @@ typedef struct {
     int mst_edges;
 } double_edge_t;
 
-point_t getRandomPointInCircle(float radius);
+point_t getRandomPointInCircle(float radius, uint64_t seed, int roomNum);
 int isOverlapping(rectangle_t *rooms, int i1, int i2);
 int anyOverlapping(rectangle_t *rooms, int numRooms);
 
-/* Initializes rooms, numRooms, mainRoomIndices, and numMainRooms */
-void generate(dungeon_t *dungeon, int numRooms, int radius);
+void defaultGenParams(gen_params_t *params);
+
+/* Initializes rooms, numRooms, mainRoomIndices, and numMainRooms from params */
+void generate(dungeon_t *dungeon, gen_params_t *params);
+
+/* Sets mainRoomIndices and numMainRooms, the indices come out in increasing order */
+void selectMainRooms(dungeon_t *dungeon, main_room_params_t *criteria);
 
-/* Separates room centers */
-void separateRooms(dungeon_t *dungeon);
+/*
+ * Separates room centers, returns the number of iterations it took. Stops
+ * early, with rooms still overlapping, when params.control says so.
+ */
+int separateRooms(dungeon_t *dungeon);
 
-/* Initializes hallways and numHallways */
+/* Initializes hallways, numHallways, segments and numSegments */
 double_edge_t *constructHallways(dungeon_t *dungeon);
 
 /* finds non-main rooms to include in final generation */
 void getIncludedRooms(dungeon_t* dungeon);
+
+/* single-threaded getIncludedRooms over the segments, used to verify the parallel version */
+void getIncludedRoomsSequential(dungeon_t* dungeon);
+
+/*
+ * Runs getIncludedRoomsSequential on a copy of the rooms, returns how many
+ * rooms it marks included or main differently than dungeon->rooms are
+ */
+int verifyIncludedRooms(dungeon_t* dungeon);
+
+/* places doors where hallways cross the walls of included rooms, sets BIT_NO_*_EDGE */
+void fixRoomEdges(dungeon_t* dungeon);
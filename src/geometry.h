@@ -0,0 +1,110 @@
+/*
+ * Geometry kernels specialized on coordinate type and dimension.
+ *
+ * Boxes are given by a center and half extents per axis. The kernels take
+ * the coordinate type T (int16_t, int32_t, float or double) and the
+ * dimension D (2 or 3) as template parameters, so the per-axis loops are
+ * unrolled at compile time and only the combinations a stage uses get
+ * compiled. separateRooms steers with <float, 2>, the pairwise overlap scans
+ * over the SoA rooms in rooms.h test spansOverlap<float> per axis, routing
+ * tests tiles against room boxes with <int, 2>, and the floor tile spans of
+ * rooms (hallways, rasterization, routing, chunk clipping) all come from
+ * tileSpan<float>. geometrycheck.cpp instantiates and checks every type and
+ * dimension, make check builds and runs it.
+ *
+ * Integer instantiations work in half-tile units: callers double centers and
+ * sizes so that half extents stay whole. Steering and distances are computed
+ * in float for float and integer coordinates and in double for double, which
+ * for <float, 2> is exactly what separateRooms did before.
+ *
+ * Include after generate.h.
+ */
+
+#include <cmath>
+#include <type_traits>
+
+// arithmetic type the steering math runs in
+template <typename T>
+struct geom_real_t {
+    typedef typename std::conditional<std::is_same<T, double>::value, double, float>::type type;
+};
+
+// calls f(0) .. f(N - 1), expanded at compile time
+template <int N>
+struct geom_unroll_t {
+    template <typename F>
+    static inline void each(F f) { geom_unroll_t<N - 1>::each(f); f(N - 1); }
+};
+
+template <>
+struct geom_unroll_t<0> {
+    template <typename F>
+    static inline void each(F) {}
+};
+
+/*
+ * Spans a and b along one axis overlap, touching ends count as overlapping.
+ * Branch free, so the SoA scans vectorize with it inlined.
+ */
+template <typename T>
+static inline bool spansOverlap(T centerA, T halfA, T centerB, T halfB) {
+    return !((centerA + halfA < centerB - halfB) | (centerB + halfB < centerA - halfA));
+}
+
+/* Boxes a and b overlap, touching faces count as overlapping */
+template <typename T, int D>
+static inline bool boxesOverlap(const T *centerA, const T *halfA, const T *centerB, const T *halfB) {
+    static_assert(D == 2 || D == 3, "boxes are 2D or 3D");
+    for (int d = 0; d < D; d++)
+        if (!spansOverlap(centerA[d], halfA[d], centerB[d], halfB[d]))
+            return false;
+    return true;
+}
+
+/*
+ * One separation step for a box at from pushed by a box at to: the unit
+ * direction from -> to rounded per axis, with zero components replaced by 1
+ * so boxes on the same line or point still move apart.
+ */
+template <typename T, int D>
+static inline void steerStep(const T *from, const T *to, typename geom_real_t<T>::type *step) {
+    typedef typename geom_real_t<T>::type real;
+    double sum = 0;
+    geom_unroll_t<D>::each([&](int d) {
+        step[d] = (real)to[d] - (real)from[d];
+        sum += pow(step[d], 2);
+    });
+    real dist = sqrt(sum);
+    if (round(dist) == 0)
+        dist = (real)0.001;
+    geom_unroll_t<D>::each([&](int d) {
+        step[d] = round(step[d] / dist);
+        if (step[d] == 0)
+            step[d] = 1;
+    });
+}
+
+/*
+ * Floor tile span [first, first + size - 1] of a box along one axis, the
+ * convention rasterizeDungeon draws rooms with
+ */
+template <typename T>
+static inline void tileSpan(T center, T size, T *first, T *last) {
+    typedef typename geom_real_t<T>::type real;
+    *first = (T)floor((real)center - (real)size / 2);
+    *last = *first + size - 1;
+}
+
+/*
+ * Whether a corridor at the floor of the midpoint between two boxes along an
+ * axis runs through the tile spans of both, the straight hallway test
+ */
+template <typename T>
+static inline bool sharedSpan(T centerA, T sizeA, T centerB, T sizeB, T *mid) {
+    typedef typename geom_real_t<T>::type real;
+    T firstA, lastA, firstB, lastB;
+    tileSpan(centerA, sizeA, &firstA, &lastA);
+    tileSpan(centerB, sizeB, &firstB, &lastB);
+    *mid = (T)floor(((real)centerA + (real)centerB) / 2);
+    return firstA <= *mid && *mid <= lastA && firstB <= *mid && *mid <= lastB;
+}
@@ -0,0 +1,101 @@
+/*
+ * Geometry kernel check, built and run by make check
+ *
+ * The stages only use a few of the kernels' type and dimension combinations,
+ * so the others would never be compiled. This instantiates every kernel for
+ * each coordinate type geometry.h supports (int16_t, int32_t, float, double)
+ * in 2 and 3 dimensions, and checks each one on boxes that overlap, touch
+ * and stay apart. Exits with 1 and names the failing case otherwise.
+ */
+
+#include <cstdio>
+#include <cstdint>
+
+#include "generate.h"
+#include "geometry.h"
+
+#define GEOMETRY_INSTANTIATE(T, D) \
+    template bool boxesOverlap<T, D>(const T *, const T *, const T *, const T *); \
+    template void steerStep<T, D>(const T *, const T *, geom_real_t<T>::type *);
+
+#define GEOMETRY_INSTANTIATE_SPANS(T) \
+    template bool spansOverlap<T>(T, T, T, T); \
+    template void tileSpan<T>(T, T, T *, T *); \
+    template bool sharedSpan<T>(T, T, T, T, T *);
+
+GEOMETRY_INSTANTIATE(int16_t, 2)
+GEOMETRY_INSTANTIATE(int16_t, 3)
+GEOMETRY_INSTANTIATE(int32_t, 2)
+GEOMETRY_INSTANTIATE(int32_t, 3)
+GEOMETRY_INSTANTIATE(float, 2)
+GEOMETRY_INSTANTIATE(float, 3)
+GEOMETRY_INSTANTIATE(double, 2)
+GEOMETRY_INSTANTIATE(double, 3)
+
+GEOMETRY_INSTANTIATE_SPANS(int16_t)
+GEOMETRY_INSTANTIATE_SPANS(int32_t)
+GEOMETRY_INSTANTIATE_SPANS(float)
+GEOMETRY_INSTANTIATE_SPANS(double)
+
+static int failures = 0;
+
+static void expect(bool ok, const char *what, const char *type, int dim) {
+    if (!ok) {
+        printf("geometry check FAILED: %s for <%s, %d>\n", what, type, dim);
+        failures++;
+    }
+}
+
+// Boxes of half extent 2 on every axis, b moved along the first axis
+template <typename T, int D>
+static void checkBoxes(const char *type) {
+    T center[D], half[D], other[D];
+    for (int d = 0; d < D; d++) {
+        center[d] = 0;
+        half[d] = 2;
+        other[d] = 0;
+    }
+    other[0] = 3;
+    expect(boxesOverlap<T, D>(center, half, other, half), "overlapping boxes", type, D);
+    other[0] = 4;
+    expect(boxesOverlap<T, D>(center, half, other, half), "touching boxes", type, D);
+    other[0] = 5;
+    expect(!boxesOverlap<T, D>(center, half, other, half), "separate boxes", type, D);
+
+    // pushed straight along the first axis, the other axes get the nudge of 1
+    typename geom_real_t<T>::type step[D];
+    steerStep<T, D>(center, other, step);
+    expect(step[0] == 1, "steering along the axis", type, D);
+    for (int d = 1; d < D; d++)
+        expect(step[d] == 1, "steering off the axis", type, D);
+}
+
+// Spans in whole tiles, sizes 4 and 6 centered 5 tiles apart
+template <typename T>
+static void checkSpans(const char *type) {
+    T first, last, mid;
+    tileSpan<T>(10, 4, &first, &last);
+    expect(first == 8 && last == 11, "tile span", type, 1);
+    expect(sharedSpan<T>(10, 4, 15, 6, &mid) == false, "disjoint spans", type, 1);
+    expect(sharedSpan<T>(10, 8, 12, 6, &mid) && mid == 11, "shared span", type, 1);
+    expect(spansOverlap<T>(0, 2, 4, 2) && !spansOverlap<T>(0, 2, 5, 2), "span overlap", type, 1);
+}
+
+int main() {
+    checkBoxes<int16_t, 2>("int16_t");
+    checkBoxes<int16_t, 3>("int16_t");
+    checkBoxes<int32_t, 2>("int32_t");
+    checkBoxes<int32_t, 3>("int32_t");
+    checkBoxes<float, 2>("float");
+    checkBoxes<float, 3>("float");
+    checkBoxes<double, 2>("double");
+    checkBoxes<double, 3>("double");
+    checkSpans<int16_t>("int16_t");
+    checkSpans<int32_t>("int32_t");
+    checkSpans<float>("float");
+    checkSpans<double>("double");
+    if (failures)
+        return 1;
+    printf("geometry check passed\n");
+    return 0;
+}
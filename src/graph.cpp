@@ -0,0 +1,200 @@
+/*
+ * Main-room graph analytics
+ *
+ * The hallway edges are turned into a CSR adjacency once, after which every
+ * query (depths, dead ends, loops) is a linear sweep over two
+ * flat arrays instead of a scan over the edge list.
+ */
+
+#include <cstdlib>
+#include <cstdio>
+#include <algorithm>
+#include <atomic>
+#include <new>
+
+#include "generate.h"
+#include "graph.h"
+#include "arena.h"
+#include "pool.h"
+
+room_graph_t *buildRoomGraph(dungeon_t *dungeon, double_edge_t *mst_dela) {
+    int numVertices = dungeon->numMainRooms;
+    int numHallways = mst_dela->mst_edges;
+    edge_t *mst = mst_dela->mst;
+
+    // Edges store room indices, map them back to main room (vertex) ids
+    arena_t *arena = scratchArena();
+    arena_mark_t mark = arenaMark(arena);
+    int *roomToVertex = (int *)arenaAlloc(arena, sizeof(int) * dungeon->numRooms);
+    for (int i = 0; i < dungeon->numRooms; i++)
+        roomToVertex[i] = -1;
+    for (int v = 0; v < numVertices; v++)
+        roomToVertex[dungeon->mainRoomIndices[v]] = v;
+
+    room_graph_t *graph = (room_graph_t *)malloc(sizeof(room_graph_t));
+    graph->numVertices = numVertices;
+    graph->offsets = (int *)calloc(numVertices + 1, sizeof(int));
+    graph->neighbors = (int *)malloc(sizeof(int) * (numHallways > 0 ? numHallways * 2 : 1));
+
+    // Count degrees, shifted by one so the prefix sum gives the row starts.
+    // Edges with an end that isn't a main room have no vertex and are skipped.
+    for (int i = 0; i < numHallways; i++) {
+        int src = roomToVertex[mst[i].src];
+        int dest = roomToVertex[mst[i].dest];
+        if (src < 0 || dest < 0)
+            continue;
+        graph->offsets[src + 1] += 1;
+        graph->offsets[dest + 1] += 1;
+    }
+    for (int v = 0; v < numVertices; v++)
+        graph->offsets[v + 1] += graph->offsets[v];
+    graph->numEdges = graph->offsets[numVertices];
+
+    // Fill rows, each hallway goes in both directions
+    int *cursor = (int *)arenaAlloc(arena, sizeof(int) * numVertices);
+    for (int v = 0; v < numVertices; v++)
+        cursor[v] = graph->offsets[v];
+    for (int i = 0; i < numHallways; i++) {
+        int src = roomToVertex[mst[i].src];
+        int dest = roomToVertex[mst[i].dest];
+        if (src < 0 || dest < 0)
+            continue;
+        graph->neighbors[cursor[src]++] = dest;
+        graph->neighbors[cursor[dest]++] = src;
+    }
+
+    arenaRelease(arena, mark);
+    return graph;
+}
+
+void freeRoomGraph(room_graph_t *graph) {
+    free(graph->offsets);
+    free(graph->neighbors);
+    free(graph);
+}
+
+// Level-synchronous BFS, threads split the current frontier and claim
+// unvisited neighbors with a compare-and-swap on their distance
+void roomGraphBFS(room_graph_t *graph, int source, int *dist) {
+    int numVertices = graph->numVertices;
+    for (int v = 0; v < numVertices; v++)
+        dist[v] = -1;
+    if (source < 0 || source >= numVertices)
+        return;
+
+    arena_t *arena = scratchArena();
+    arena_mark_t mark = arenaMark(arena);
+    std::atomic<int> *depth = (std::atomic<int> *)arenaAlloc(arena, sizeof(std::atomic<int>) * numVertices);
+    for (int v = 0; v < numVertices; v++)
+        new (&depth[v]) std::atomic<int>(-1);
+    int *frontier = (int *)arenaAlloc(arena, sizeof(int) * numVertices);
+    int *next = (int *)arenaAlloc(arena, sizeof(int) * numVertices);
+    int frontierSize = 1;
+    frontier[0] = source;
+    depth[source] = 0;
+
+    int level = 0;
+    while (frontierSize > 0) {
+        std::atomic<int> nextSize(0);
+        parallelFor(0, frontierSize, 64, [&](int f) {
+            int v = frontier[f];
+            for (int e = graph->offsets[v]; e < graph->offsets[v + 1]; e++) {
+                int u = graph->neighbors[e];
+                int unvisited = -1;
+                if (depth[u].load(std::memory_order_relaxed) == -1 &&
+                    depth[u].compare_exchange_strong(unvisited, level + 1))
+                    next[nextSize++] = u;
+            }
+        });
+        int *tmp = frontier;
+        frontier = next;
+        next = tmp;
+        frontierSize = nextSize;
+        level += 1;
+    }
+
+    for (int v = 0; v < numVertices; v++)
+        dist[v] = depth[v];
+    arenaRelease(arena, mark);
+}
+
+// vertices per roomGraphStats task
+#define STATS_CHUNK 4096
+
+typedef struct {
+    int deadEnds;
+    int reachable;
+    long depthSum;
+    int maxDepth;
+} stats_partial_t;
+
+void roomGraphStats(room_graph_t *graph, int entrance, room_graph_stats_t *stats) {
+    int numVertices = graph->numVertices;
+    stats->entrance = entrance;
+    stats->reachable = 0;
+    stats->deadEnds = 0;
+    stats->numLoops = 0;
+    stats->maxDepth = 0;
+    stats->meanDepth = 0.0f;
+    if (numVertices == 0)
+        return;
+
+    arena_t *arena = scratchArena();
+    arena_mark_t mark = arenaMark(arena);
+    int *dist = (int *)arenaAlloc(arena, sizeof(int) * numVertices);
+    int *queue = (int *)arenaAlloc(arena, sizeof(int) * numVertices);
+
+    // Components are needed for the cycle count, the entrance's comes from the parallel BFS
+    roomGraphBFS(graph, entrance, dist);
+
+    // Dead ends and depths per chunk of vertices, summed in chunk order
+    int numChunks = (numVertices + STATS_CHUNK - 1) / STATS_CHUNK;
+    stats_partial_t *partials = (stats_partial_t *)arenaAlloc(arena, sizeof(stats_partial_t) * numChunks);
+    parallelFor(0, numChunks, 1, [&](int c) {
+        stats_partial_t p = {0, 0, 0, 0};
+        int last = std::min((c + 1) * STATS_CHUNK, numVertices);
+        for (int v = c * STATS_CHUNK; v < last; v++) {
+            if (graph->offsets[v + 1] - graph->offsets[v] == 1)
+                p.deadEnds += 1;
+            if (dist[v] < 0)
+                continue;
+            p.reachable += 1;
+            p.depthSum += dist[v];
+            p.maxDepth = std::max(p.maxDepth, dist[v]);
+        }
+        partials[c] = p;
+    });
+    long depthSum = 0;
+    for (int c = 0; c < numChunks; c++) {
+        stats->deadEnds += partials[c].deadEnds;
+        stats->reachable += partials[c].reachable;
+        depthSum += partials[c].depthSum;
+        stats->maxDepth = std::max(stats->maxDepth, partials[c].maxDepth);
+    }
+    if (stats->reachable > 0)
+        stats->meanDepth = (float)depthSum / stats->reachable;
+
+    int components = (stats->reachable > 0) ? 1 : 0;
+    for (int v = 0; v < numVertices; v++) {
+        if (dist[v] != -1)
+            continue;
+        // Mark other components with -2 so they are only counted once
+        int head = 0;
+        int tail = 0;
+        queue[tail++] = v;
+        dist[v] = -2;
+        while (head < tail) {
+            int w = queue[head++];
+            for (int e = graph->offsets[w]; e < graph->offsets[w + 1]; e++) {
+                if (dist[graph->neighbors[e]] == -1) {
+                    dist[graph->neighbors[e]] = -2;
+                    queue[tail++] = graph->neighbors[e];
+                }
+            }
+        }
+        components += 1;
+    }
+    stats->numLoops = graph->numEdges / 2 - numVertices + components;
+
+    arenaRelease(arena, mark);
+}
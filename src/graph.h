@@ -0,0 +1,33 @@
+/*
+ * Compressed sparse row (CSR) adjacency of the main-room graph, built from
+ * the hallway edges returned by constructHallways.
+ *
+ * Vertex v of the graph is the main room dungeon->mainRoomIndices[v], so the
+ * vertex ids line up with everything else that indexes main rooms.
+ */
+
+typedef struct {
+    int numVertices;
+    int numEdges;     // directed entries, each hallway is stored both ways
+    int *offsets;     // numVertices + 1 entries, neighbors of v are in [offsets[v], offsets[v + 1])
+    int *neighbors;   // numEdges vertex ids
+} room_graph_t;
+
+typedef struct {
+    int entrance;     // vertex the depths are measured from
+    int reachable;    // vertices reachable from the entrance, entrance included
+    int deadEnds;     // vertices with exactly one hallway
+    int numLoops;     // independent cycles, E - V + number of components
+    int maxDepth;     // hops to the farthest reachable vertex
+    float meanDepth;  // average hops over reachable vertices
+} room_graph_stats_t;
+
+/* Builds the CSR adjacency of the main rooms from the hallway edges, leaving out edges to other rooms */
+room_graph_t *buildRoomGraph(dungeon_t *dungeon, double_edge_t *mst_dela);
+void freeRoomGraph(room_graph_t *graph);
+
+/* Parallel level-synchronous BFS, dist[v] is the hop count from source or -1 */
+void roomGraphBFS(room_graph_t *graph, int source, int *dist);
+
+/* Gameplay metrics (dead ends, loops, depth from the entrance) */
+void roomGraphStats(room_graph_t *graph, int entrance, room_graph_stats_t *stats);
@@ -8,106 +8,76 @@
 #include <omp.h>
 
 #include "generate.h"
+#include "graph.h"
+#include "tilemap.h"
+#include "validate.h"
+#include "dungeonfile.h"
+#include "cache.h"
+#include "pipeline.h"
+#include "dungeon.h"
+#include "options.h"
+#include "pool.h"
 #include "main.h"
 #include <SDL.h>
 
 // #define VSTUDIO
 
-static int _argc;
-static char **_argv;
-
-// Get number of threads
-int get_option_int(const char *option_name, int default_value) {
-    for (int i = _argc - 2; i >= 0; i -= 2)
-        if (strcmp(_argv[i], option_name) == 0)
-            return atoi(_argv[i + 1]);
-    return default_value;
-}
-
-// Rough "quality" metric for dungeons, area of bounding rectangle
-float get_solution_quality(dungeon_t *dungeon) {
-    rectangle_t *rooms = dungeon->rooms;
-    int numRooms = dungeon->numRooms;
-    float top = std::numeric_limits<float>::max();
-    float bottom = std::numeric_limits<float>::min();
-    float left = std::numeric_limits<float>::max();
-    float right = std::numeric_limits<float>::min();
-    for (int i = 0; i < numRooms; i++) {
-        top = std::min(top, rooms[i].center.y - rooms[i].height / 2);
-        bottom = std::max(bottom, rooms[i].center.y + rooms[i].height / 2);
-        left = std::min(left, rooms[i].center.x - rooms[i].width / 2);
-        right = std::max(right, rooms[i].center.y + rooms[i].width / 2);
-    }
-    return (bottom - top) * (right - left);
-}
-
 int main(int argc, char** argv) {
-    _argc = argc - 1;
-    _argv = argv + 1;
+    initOptions(argc, argv);
     int num_of_threads = get_option_int("-n", 1);
+    int use_routing = get_option_int("-a", 0);
+    int cache_mb = get_option_int("-c", 0);
+    int save_dungeon = get_option_int("-d", 0);
+    int runtime = get_option_int("-t", POOL_RUNTIME_STEALING);
+    if (get_option_int("-b", 0) > 0 || get_option_int("-k", 0) > 0 || get_option_int("-w", 0) > 0) {
+        printf("Batch, chunk and world modes are in the headless dungeon CLI\n");
+        return 1;
+    }
     omp_set_num_threads(num_of_threads);
+    initPool(num_of_threads, runtime);
     printf("Number of threads: %d\n", num_of_threads);
 
-    // getting room generation number
-    int roomNum = 500;
-    printf("Enter Number of Rooms: ");
-    scanf("%d", &roomNum);
-    printf("Generating %d Rooms\n", roomNum);
-
-    // set up any timing before calling algorithm functions
-    typedef std::chrono::high_resolution_clock Clock;
-    typedef std::chrono::duration<double> dsec;
-
-    auto init_start = Clock::now();
-    double generate_time = 0;
-    double time_difference = 0;
-
+    gen_params_t params;
+    genParamsFromOptions(&params);
 
-    dungeon_t d;
-    dungeon_t *dungeon = &d;
-    double_edge_t md;
-    double_edge_t *mst_dela = &md;
-
-    // insert timing functions here
-
-    generate(dungeon, roomNum, 25);
-    generate_time = std::chrono::duration_cast<dsec>(Clock::now() - init_start).count();
-    printf("Initial Room Generation Time: %lfs\n", generate_time);
-
-    separateRooms(dungeon);
-    time_difference = std::chrono::duration_cast<dsec>(Clock::now() - init_start).count() - generate_time;
-    generate_time += time_difference;
-    printf("Room Separation Time: %lfs\n", time_difference);
+    // getting room generation number
+    if (params.numRooms <= 0) {
+        params.numRooms = 500;
+        printf("Enter Number of Rooms: ");
+        scanf("%d", &params.numRooms);
+    }
 
-    mst_dela = constructHallways(dungeon);
-    time_difference = std::chrono::duration_cast<dsec>(Clock::now() - init_start).count() - generate_time;
-    generate_time += time_difference;
-    printf("MST and Delaunay Time: %lfs\n", time_difference);
+    // -c <MB> keeps generated dungeons in ./dungeon_cache, bounded to that size
+    dungeon_cache_t cache_store;
+    dungeon_cache_t *cache = NULL;
+    if (cache_mb > 0) {
+        initDungeonCache(&cache_store, "dungeon_cache", (size_t)cache_mb << 20);
+        cache = &cache_store;
+    }
 
-    getIncludedRooms(dungeon);
-    time_difference = std::chrono::duration_cast<dsec>(Clock::now() - init_start).count() - generate_time;
-    generate_time += time_difference;
-    printf("Included Rooms Time: %lfs\n", time_difference);
+    printf("Generating %d Rooms with seed %llu\n", params.numRooms, (unsigned long long)params.seed);
 
-    generate_time = std::chrono::duration_cast<dsec>(Clock::now() - init_start).count();
-    printf("Total Dungeon Generation Time: %lfs\n", generate_time);
+    Dungeon dungeon = Dungeon::generate(&params, use_routing, cache);
+    printPipelineSummary(dungeon.result());
 
-    float quality = get_solution_quality(dungeon);
-    printf("Dungeon solution quality (lower is better: %f\n", quality);
+    // -d 1 also saves the dungeon to dungeon.dgn for loading with openDungeonFile
+    if (save_dungeon) {
+        dungeon_file_params_t file_params;
+        if (dungeonFileParams(&params, use_routing, &file_params) &&
+            writeDungeonFile("dungeon.dgn", &file_params, dungeon.raw(), dungeon.result()->mst_dela) >= 0)
+            printf("Saved dungeon.dgn\n");
+        else
+            printf("Could not write dungeon.dgn\n");
+    }
 
     display disp(dungeon);
 
     printf("*****STARTING GUI*****\n");
 
-    int ecode = disp.OnExecute(dungeon, mst_dela);
+    int ecode = disp.OnExecute();
 
     printf("***** CLOSING GUI*****\n");
 
-    
-    free(dungeon->rooms);
-    free(dungeon->mainRoomIndices);
-    free(dungeon->hallways);
-
     return ecode;
     //return 0;
 }
@@ -116,41 +86,9 @@ int main(int argc, char** argv) {
  *                            Prerender functions 
  *****************************************************************************/
 
-// function to modify rooms when hallways touch the edge of a room
-/* function should essentially knock off the side wall of the room touching 
-   the hallway (could also be parallelized) */
+// wall knockout for hallways touching rooms is done by fixRoomEdges in generate.cpp
 
-// int checkEdge(rectangle_t* room, hallway_t* hallway) {
-
-// }
-
-// void fixRoomEdges(dungeon_t* dungeon) {
-//     for (int roomInd = 0; roomInd < dungeon->numRooms; roomInd++) {
-//         rectangle_t* room = &dungeon->rooms[roomInd];
-//         if (!(room->status & BIT_INCLUDED))
-//             continue;
-//         // code looks familiar?
-//         float topLeftx = dungeon->rooms[roomNum].center.x - dungeon->rooms[roomNum].width/2;
-//         float topLefty = dungeon->rooms[roomNum].center.y - dungeon->rooms[roomNum].height/2;
-//         float botRightx = dungeon->rooms[roomNum].center.x + dungeon->rooms[roomNum].width/2;
-//         float botRighty = dungeon->rooms[roomNum].center.y + dungeon->rooms[roomNum].height/2;
-
-//         for (int hallInd = 0; hallInd < dungeon->numHallways; hallInd++) {
-//             hallway_t* hall = &dungeon->hallways[hallInd];
-
-//             // check both hallway segments if adjacent to current room
-//             if ()
-
-//         }
-//     }
-// }
-
-
-
-// function to deal with hallway intersections
-// create list of all hallway intersections 
-/* intersections should not exist when hallways are directly on top of eachother
-   and travelling in the same direction (this will be hard) */
+// hallway intersections are handled by mergeHallways in sweep.cpp
 
 
 
@@ -161,7 +99,7 @@ int main(int argc, char** argv) {
 /*
  * Class constructor
  */
-display::display(dungeon_t *dungeon) {
+display::display(const Dungeon &dungeon) {
     running = true;
     currRoomNumber = 0;
     pixPerUnit = 5;
@@ -169,7 +107,7 @@ display::display(dungeon_t *dungeon) {
     y_offset = 0;
     room_view = 0;
     show_hallways = 0;
-    dungeon_data = dungeon;
+    dungeon_data = &dungeon;
     show_tree = 0;
 }
 
@@ -246,7 +184,7 @@ void display::loadAssets() {
 /*
  * Execution Loop
  */
-int display::OnExecute(dungeon_t *dungeon, double_edge_t *mst_dela) {
+int display::OnExecute() {
     if (OnInit() == false)
         return -1;
 
@@ -261,7 +199,7 @@ int display::OnExecute(dungeon_t *dungeon, double_edge_t *mst_dela) {
             OnEvent(&Event);
         }
 
-        OnRender(dungeon, mst_dela);
+        OnRender();
 
         OnLoop();
     }
@@ -306,8 +244,9 @@ void display::OnEvent(SDL_Event* event) {
         if (currentKeyStates[SDL_SCANCODE_2])
             currRoomNumber += 1;
         if (currentKeyStates[SDL_SCANCODE_3]) {
-            if (show_hallways != dungeon_data->numHallways)
-                show_hallways = dungeon_data->numHallways;
+            // segments are numbered by hallway edge, routed dungeons have no L-shaped hallways
+            if (show_hallways != dungeon_data->mstEdges().size())
+                show_hallways = dungeon_data->mstEdges().size();
             else
                 show_hallways = 0; 
 
@@ -316,7 +255,7 @@ void display::OnEvent(SDL_Event* event) {
             show_tree = (show_tree + 1) % 3;
         }
         if (currentKeyStates[SDL_SCANCODE_5]) {
-            currRoomNumber = dungeon_data->numRooms;
+            currRoomNumber = dungeon_data->rooms().size();
         }
     }
 }
@@ -390,20 +329,18 @@ int getRoomCenter(int units, int ppu, int wh) {
 /*
  * Render fuction
  */
-void display::OnRender(dungeon_t *dungeon, double_edge_t *mst_dela) {
-    // dungeon struct contents
-    rectangle_t *rooms = dungeon->rooms;
-    //int roomNum = dungeon->numRooms;
-    hallway_t *hallways = dungeon->hallways;
-    //int hallwayNum = dungeon->numHallways;
-    int *mainRoomIndices = dungeon->mainRoomIndices;
-    int mainRoomNum = dungeon->numMainRooms;
-    
-    // mst_dela struct contents
-    edge_t *dela = mst_dela->dela;
-    edge_t *mst = mst_dela->mst;
-    int dela_edges = mst_dela->dela_edges;
-    int mst_edges = mst_dela->mst_edges;
+void display::OnRender() {
+    // dungeon contents
+    view_t<rectangle_t> rooms = dungeon_data->rooms();
+    view_t<segment_t> segments = dungeon_data->segments();
+    view_t<int> mainRoomIndices = dungeon_data->mainRoomIndices();
+    int mainRoomNum = mainRoomIndices.size();
+
+    // MST and Delaunay edges
+    view_t<edge_t> dela = dungeon_data->delaunayEdges();
+    view_t<edge_t> mst = dungeon_data->mstEdges();
+    int dela_edges = dela.size();
+    int mst_edges = mst.size();
 
     // clearing old frame
     SDL_SetRenderDrawColor(renderer, 0x00, 0x00, 0x00, 0xFF);
@@ -422,7 +359,7 @@ void display::OnRender(dungeon_t *dungeon, double_edge_t *mst_dela) {
         if (room_view == 1)
             renderRoom(rooms[mainRoomIndices[room_inc]]);
         else if (room_view == 2) {
-            if (rooms[room_inc].status && BIT_INCLUDED)
+            if (rooms[room_inc].status & BIT_INCLUDED)
                 renderRoom(rooms[room_inc]);
         }
         else
@@ -431,36 +368,22 @@ void display::OnRender(dungeon_t *dungeon, double_edge_t *mst_dela) {
     }
 
     
+    // hallways are drawn from their straight segments so routed or merged
+    // corridors show up the same way as the plain L-shaped ones
     SDL_Rect hallrect;
-    for (int i = 0; i < show_hallways; i++) {
-        // render line for start-->middle
-        int hallsx = (int)hallways[i].start.x;
-        int hallsy = (int)hallways[i].start.y;
-
-        int hallmx = (int)hallways[i].middle.x;
-        int hallmy = (int)hallways[i].middle.y;
+    for (int i = 0; i < segments.size(); i++) {
+        if (segments[i].hallway >= show_hallways)
+            continue;
+        int hallsx = (int)segments[i].start.x;
+        int hallsy = (int)segments[i].start.y;
 
+        int hallex = (int)segments[i].end.x;
+        int halley = (int)segments[i].end.y;
 
-        hallrect.x = ((std::min(hallsx, hallmx) + x_offset) * pixPerUnit) + (SCREEN_WIDTH / 2);
-        hallrect.y = ((std::min(hallsy, hallmy) + y_offset) * pixPerUnit) + (SCREEN_HEIGHT / 2);
-        hallrect.w = std::max(std::abs(hallmx - hallsx) * pixPerUnit, 1);
-        hallrect.h = std::max(std::abs(hallmy - hallsy) * pixPerUnit, 1);
-
-        if (hallrect.w == 1 && hallrect.h == 1) {
-            hallrect.w = 0;
-        }
-
-        //SDL_BlitScaled(gRed, NULL, gScreenSurface, &hallrect);
-        SDL_RenderCopy(renderer, gRed, NULL, &hallrect);
-
-        // render line for middle-->end
-        int hallex = (int)hallways[i].end.x;
-        int halley = (int)hallways[i].end.y;
-
-        hallrect.x = ((std::min(hallmx, hallex) + x_offset) * pixPerUnit) + (SCREEN_WIDTH / 2);
-        hallrect.y = ((std::min(hallmy, halley) + y_offset) * pixPerUnit) + (SCREEN_HEIGHT / 2);
-        hallrect.w = std::max(std::abs(hallex - hallmx) * pixPerUnit, 1);
-        hallrect.h = std::max(std::abs(halley - hallmy) * pixPerUnit, 1);
+        hallrect.x = ((std::min(hallsx, hallex) + x_offset) * pixPerUnit) + (SCREEN_WIDTH / 2);
+        hallrect.y = ((std::min(hallsy, halley) + y_offset) * pixPerUnit) + (SCREEN_HEIGHT / 2);
+        hallrect.w = std::max(std::abs(hallex - hallsx) * pixPerUnit, 1);
+        hallrect.h = std::max(std::abs(halley - hallsy) * pixPerUnit, 1);
 
         if (hallrect.w == 1 && hallrect.h == 1) {
             hallrect.w = 0;
@@ -531,6 +454,8 @@ void display::renderRoom(rectangle_t room) {
 
     SDL_Rect sideRect;
 
+    // sides knocked out by fixRoomEdges are left open
+
     // left side
     sideRect.x = roomRect.x;
     sideRect.y = roomRect.y;
@@ -538,20 +463,23 @@ void display::renderRoom(rectangle_t room) {
     sideRect.w = 1;
 
     //SDL_BlitScaled(gSides, NULL, gScreenSurface, &sideRect);
-    SDL_RenderCopy(renderer, gSides, NULL, &sideRect);
+    if (!(room.status & BIT_NO_L_EDGE))
+        SDL_RenderCopy(renderer, gSides, NULL, &sideRect);
 
     // top side
     sideRect.h = 1;
     sideRect.w = roomRect.w;
 
     //SDL_BlitScaled(gSides, NULL, gScreenSurface, &sideRect);
-    SDL_RenderCopy(renderer, gSides, NULL, &sideRect);
+    if (!(room.status & BIT_NO_T_EDGE))
+        SDL_RenderCopy(renderer, gSides, NULL, &sideRect);
 
     // bottom side
     sideRect.y = roomRect.y + roomRect.h - 1;
 
     //SDL_BlitScaled(gSides, NULL, gScreenSurface, &sideRect);
-    SDL_RenderCopy(renderer, gSides, NULL, &sideRect);
+    if (!(room.status & BIT_NO_B_EDGE))
+        SDL_RenderCopy(renderer, gSides, NULL, &sideRect);
 
     // right side
     sideRect.x = roomRect.x + roomRect.w - 1;
@@ -560,7 +488,8 @@ void display::renderRoom(rectangle_t room) {
     sideRect.w = 1;
 
     //SDL_BlitScaled(gSides, NULL, gScreenSurface, &sideRect);
-    SDL_RenderCopy(renderer, gSides, NULL, &sideRect);
+    if (!(room.status & BIT_NO_R_EDGE))
+        SDL_RenderCopy(renderer, gSides, NULL, &sideRect);
 
     SDL_Rect dotRect;
 
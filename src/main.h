@@ -6,18 +6,7 @@
 
 #define SCREEN_HEIGHT 1024
 
-// bit masks and bit assignments
-#define BIT_INCLUDED  1 << 0
-
-#define BIT_MAINROOM  1 << 1
-
-#define BIT_NO_B_EDGE 1 << 2
-
-#define BIT_NO_T_EDGE 1 << 3
-
-#define BIT_NO_L_EDGE 1 << 4
-
-#define BIT_NO_R_EDGE 1 << 5
+class Dungeon;
 
 class display {
     private:
@@ -40,17 +29,17 @@ class display {
         int show_hallways;
         int show_tree; // 0 = none, 1 = mst, 2 = dela
 
-        // data pointers
-        dungeon_t *dungeon_data;
+        // dungeon being shown, owned by the caller and read through its views
+        const Dungeon *dungeon_data;
 
     public:
         // constructor
-        display(dungeon_t *dungeon);
-        int OnExecute(dungeon_t *dungeon, double_edge_t *mst_dela);
+        display(const Dungeon &dungeon);
+        int OnExecute();
         bool OnInit();
         void OnEvent(SDL_Event* Event);
         void OnLoop();
-        void OnRender(dungeon_t *dungeon, double_edge_t *mst_dela);
+        void OnRender();
         void OnCleanup();
 
         // other functions
@@ -0,0 +1,51 @@
+/*
+ * Command line options
+ */
+
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+
+#include "generate.h"
+#include "options.h"
+
+static int _argc;
+static char **_argv;
+
+void initOptions(int argc, char **argv) {
+    _argc = argc - 1;
+    _argv = argv + 1;
+}
+
+// Value of the last option_name, NULL when it isn't given
+static const char *get_option(const char *option_name) {
+    for (int i = _argc - 2; i >= 0; i -= 2)
+        if (strcmp(_argv[i], option_name) == 0)
+            return _argv[i + 1];
+    return NULL;
+}
+
+int get_option_int(const char *option_name, int default_value) {
+    const char *value = get_option(option_name);
+    return value ? atoi(value) : default_value;
+}
+
+float get_option_float(const char *option_name, float default_value) {
+    const char *value = get_option(option_name);
+    return value ? (float)atof(value) : default_value;
+}
+
+uint64_t get_option_u64(const char *option_name, uint64_t default_value) {
+    const char *value = get_option(option_name);
+    return value ? (uint64_t)strtoull(value, NULL, 10) : default_value;
+}
+
+void genParamsFromOptions(gen_params_t *params) {
+    defaultGenParams(params);
+    params->numRooms = get_option_int("-r", 0);
+    params->seed = get_option_u64("-s", 100);
+    params->placement = get_option_int("-p", PLACEMENT_DISC);
+    params->radius = get_option_int("-R", params->placement == PLACEMENT_DISC ? params->radius : 0);
+    params->pExtra = get_option_float("-e", params->pExtra);
+    params->maxIters = get_option_int("-i", params->maxIters);
+}
@@ -0,0 +1,21 @@
+/*
+ * Command line options given as "-x value" pairs, shared by the GUI and the
+ * headless CLI. When an option is given more than once the last one wins.
+ *
+ * Include after generate.h.
+ */
+
+/* Remembers the arguments after the program name */
+void initOptions(int argc, char **argv);
+
+int get_option_int(const char *option_name, int default_value);
+float get_option_float(const char *option_name, float default_value);
+uint64_t get_option_u64(const char *option_name, uint64_t default_value);
+
+/*
+ * Generation params from the options, defaultGenParams for the rest:
+ *   -r rooms (0 when not given)  -s seed (0 .. 2^64 - 1)  -p placement (PLACEMENT_*)
+ *   -R radius (<= 0 sizes it to the room area, the default for -p 1 and -p 2)
+ *   -e chance of an extra hallway (P_EXTRA)  -i separation iteration limit (MAX_ITERS)
+ */
+void genParamsFromOptions(gen_params_t *params);
@@ -0,0 +1,269 @@
+/*
+ * Pipeline driver
+ *
+ * Batch mode parallelizes across dungeons instead of inside them: a parallel
+ * loop hands out one dungeon at a time and nested parallelism is switched
+ * off, so every stage's own omp loops run on the calling thread. The stages
+ * keep all their state in the dungeon and in locals (the Delaunay code uses
+ * thread-local globals), which is what makes concurrent dungeons safe.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <chrono>
+#include <limits>
+#include <algorithm>
+#include <omp.h>
+
+#include "generate.h"
+#include "graph.h"
+#include "routing.h"
+#include "sweep.h"
+#include "tilemap.h"
+#include "validate.h"
+#include "cache.h"
+#include "pipeline.h"
+#include "arena.h"
+#include "pool.h"
+#include "control.h"
+
+typedef std::chrono::high_resolution_clock Clock;
+typedef std::chrono::duration<double> dsec;
+
+// Seconds since *last, moves *last to now
+static double lap(Clock::time_point *last) {
+    Clock::time_point now = Clock::now();
+    double seconds = std::chrono::duration_cast<dsec>(now - *last).count();
+    *last = now;
+    return seconds;
+}
+
+// Each step starts from an empty scratch arena and folds its peak into the
+// result, a step keeps nothing in the arena for the next one
+static arena_t *beginStep() {
+    arena_t *arena = scratchArena();
+    arenaReset(arena);
+    return arena;
+}
+
+static void endStep(arena_t *arena, pipeline_result_t *result) {
+    result->scratchPeak = std::max(result->scratchPeak, arena->peak);
+}
+
+// Ends the step early once the generation is cancelled
+static int cancelledStep(gen_params_t *params, arena_t *arena, pipeline_result_t *result) {
+    if (!genCancelled(params->control))
+        return 0;
+    endStep(arena, result);
+    return 1;
+}
+
+void pipelineLayout(gen_params_t *params, int useRouting, dungeon_cache_t *cache, pipeline_result_t *result) {
+    arena_t *arena = beginStep();
+    int verbose = params->verbose;
+    dungeon_t *dungeon = &result->dungeon;
+    result->mst_dela = NULL;
+    result->graph = NULL;
+    result->tilemap = NULL;
+    result->validation.disconnected = NULL;
+    result->validation.numDisconnected = 0;
+    result->separationIters = 0;
+    result->overused = 0;
+    result->scratchPeak = 0;
+    genSetStage(params->control, GEN_STAGE_LAYOUT);
+    Clock::time_point last = Clock::now();
+
+    // generate through fixRoomEdges depend only on the params and may come from the cache
+    result->cached = cache && cacheLoad(cache, params, useRouting, dungeon, &result->mst_dela);
+    if (result->cached) {
+        if (verbose)
+            printf("Cache Load Time: %lfs\n", lap(&last));
+    }
+    else {
+        generate(dungeon, params);
+        if (verbose)
+            printf("Initial Room Generation Time: %lfs\n", lap(&last));
+
+        result->separationIters = separateRooms(dungeon);
+        if (verbose)
+            printf("Room Separation Time: %lfs (%d iterations)\n", lap(&last), result->separationIters);
+    }
+    endStep(arena, result);
+}
+
+void pipelineHallways(gen_params_t *params, int useRouting, dungeon_cache_t *cache, pipeline_result_t *result) {
+    if (result->cached || genCancelled(params->control))
+        return;
+    genSetStage(params->control, GEN_STAGE_HALLWAYS);
+    arena_t *arena = beginStep();
+    int verbose = params->verbose;
+    dungeon_t *dungeon = &result->dungeon;
+    Clock::time_point last = Clock::now();
+
+    result->mst_dela = constructHallways(dungeon);
+    if (verbose)
+        printf("MST and Delaunay Time: %lfs\n", lap(&last));
+
+    if (useRouting && !genCancelled(params->control)) {
+        routing_params_t routing_params;
+        defaultRoutingParams(&routing_params);
+        result->overused = routeHallways(dungeon, result->mst_dela, &routing_params);
+        if (verbose)
+            printf("Hallway Routing Time: %lfs (%d overused tiles)\n", lap(&last), result->overused);
+    }
+    endStep(arena, result);
+}
+
+void pipelineFinish(gen_params_t *params, int useRouting, dungeon_cache_t *cache, pipeline_result_t *result) {
+    if (genCancelled(params->control))
+        return;
+    genSetStage(params->control, GEN_STAGE_FINISH);
+    arena_t *arena = beginStep();
+    int verbose = params->verbose;
+    dungeon_t *dungeon = &result->dungeon;
+    Clock::time_point last = Clock::now();
+
+    if (!result->cached) {
+        int segments_before = dungeon->numSegments;
+        mergeHallways(dungeon);
+        if (verbose)
+            printf("Hallway Merge Time: %lfs (%d -> %d segments, %d crossings)\n",
+                   lap(&last), segments_before, dungeon->numSegments, dungeon->numCrossings);
+        if (cancelledStep(params, arena, result))
+            return;
+
+        getIncludedRooms(dungeon);
+        if (verbose)
+            printf("Included Rooms Time: %lfs\n", lap(&last));
+        if (cancelledStep(params, arena, result))
+            return;
+
+        fixRoomEdges(dungeon);
+        if (verbose)
+            printf("Room Edge Fix Time: %lfs (%d doors)\n", lap(&last), dungeon->numDoors);
+        if (cancelledStep(params, arena, result))
+            return;
+        // a dungeon cut short by the deadline isn't what the params produce
+        if (cache && !genStoppedEarly(params->control))
+            cacheStore(cache, params, useRouting, dungeon, result->mst_dela);
+    }
+
+    result->graph = buildRoomGraph(dungeon, result->mst_dela);
+    roomGraphStats(result->graph, 0, &result->graphStats);
+    if (verbose)
+        printf("Room Graph Time: %lfs\n", lap(&last));
+    if (cancelledStep(params, arena, result))
+        return;
+
+    result->tilemap = rasterizeDungeon(dungeon);
+    if (verbose)
+        printf("Tile Rasterization Time: %lfs\n", lap(&last));
+    if (cancelledStep(params, arena, result))
+        return;
+
+    validateDungeon(dungeon, result->tilemap, &result->validation);
+    if (verbose)
+        printf("Validation Time: %lfs\n", lap(&last));
+    endStep(arena, result);
+    genSetStage(params->control, GEN_STAGE_DONE);
+}
+
+void runPipeline(gen_params_t *params, int useRouting, dungeon_cache_t *cache, pipeline_result_t *result) {
+    Clock::time_point start = Clock::now();
+    pipelineLayout(params, useRouting, cache, result);
+    pipelineHallways(params, useRouting, cache, result);
+    pipelineFinish(params, useRouting, cache, result);
+    if (params->verbose) {
+        printf("Scratch Memory Peak: %.1f KB (%.1f KB reserved)\n", result->scratchPeak / 1024.0,
+               scratchArena()->reserved / 1024.0);
+        printf("Total Dungeon Generation Time: %lfs\n", std::chrono::duration_cast<dsec>(Clock::now() - start).count());
+    }
+}
+
+void freePipelineResult(pipeline_result_t *result) {
+    dungeon_t *dungeon = &result->dungeon;
+    free(dungeon->rooms);
+    free(dungeon->mainRoomIndices);
+    free(dungeon->hallways);
+    free(dungeon->segments);
+    free(dungeon->crossings);
+    free(dungeon->doors);
+    // a cancelled generation stops before the later steps fill these in
+    if (result->mst_dela) {
+        free(result->mst_dela->dela);
+        free(result->mst_dela->mst);
+        free(result->mst_dela);
+    }
+    if (result->graph)
+        freeRoomGraph(result->graph);
+    if (result->tilemap)
+        freeTilemap(result->tilemap);
+    freeValidation(&result->validation);
+}
+
+// Rough "quality" metric for dungeons, area of bounding rectangle
+static float solutionQuality(const dungeon_t *dungeon) {
+    float top = std::numeric_limits<float>::max();
+    float bottom = std::numeric_limits<float>::min();
+    float left = std::numeric_limits<float>::max();
+    float right = std::numeric_limits<float>::min();
+    for (int i = 0; i < dungeon->numRooms; i++) {
+        const rectangle_t *room = &dungeon->rooms[i];
+        top = std::min(top, room->center.y - room->height / 2);
+        bottom = std::max(bottom, room->center.y + room->height / 2);
+        left = std::min(left, room->center.x - room->width / 2);
+        right = std::max(right, room->center.y + room->width / 2);
+    }
+    return (bottom - top) * (right - left);
+}
+
+void printPipelineSummary(const pipeline_result_t *result) {
+    // a cancelled generation stops before the tile map, or hands back nothing
+    if (!result->tilemap) {
+        printf("Generation stopped before it finished, %d rooms and no tile map\n", result->dungeon.numRooms);
+        return;
+    }
+    const room_graph_stats_t *graph_stats = &result->graphStats;
+    const validation_t *validation = &result->validation;
+    printf("Dungeon solution quality (lower is better: %f\n", solutionQuality(&result->dungeon));
+    printf("Room graph: %d dead ends, %d loops, max depth %d, mean depth %f\n",
+           graph_stats->deadEnds, graph_stats->numLoops, graph_stats->maxDepth, graph_stats->meanDepth);
+    printf("Tile map: %d x %d tiles, %zu bytes\n", result->tilemap->width, result->tilemap->height,
+           tilemapBytes(result->tilemap));
+    if (validation->connected) {
+        printf("Validation passed: all %d main rooms reachable\n", result->dungeon.numMainRooms);
+    }
+    else {
+        printf("Validation FAILED: %d of %d main rooms unreachable from the entrance:",
+               validation->numDisconnected, result->dungeon.numMainRooms);
+        for (int i = 0; i < validation->numDisconnected; i++)
+            printf(" %d", validation->disconnected[i]);
+        printf("\n");
+    }
+}
+
+void generateBatch(gen_params_t *params, int count, int useRouting, dungeon_cache_t *cache,
+                   batch_sink_t sink, void *ctx) {
+    int max_levels = omp_get_max_active_levels();
+    int max_threads = omp_get_max_threads();
+    omp_set_max_active_levels(1);
+    // the caller runs dungeons alongside the pool threads, so its stages'
+    // omp loops go single threaded like theirs
+    if (poolRuntime() == POOL_RUNTIME_STEALING && !poolInline())
+        omp_set_num_threads(1);
+
+    parallelFor(0, count, 1, [&](int i) {
+        gen_params_t dungeon_params = *params;
+        dungeon_params.seed = params->seed + i;
+        dungeon_params.verbose = 0;
+
+        pipeline_result_t result;
+        runPipeline(&dungeon_params, useRouting, cache, &result);
+        #pragma omp critical(batch_sink)
+        sink(i, &result, ctx);
+        freePipelineResult(&result);
+    });
+
+    omp_set_num_threads(max_threads);
+    omp_set_max_active_levels(max_levels);
+}
@@ -0,0 +1,59 @@
+/*
+ * The whole generation pipeline for one dungeon, from generate through
+ * validation, and batch generation of many independent dungeons.
+ *
+ * Include after generate.h, graph.h, tilemap.h, validate.h and cache.h.
+ */
+
+typedef struct {
+    dungeon_t dungeon;
+    double_edge_t *mst_dela;
+    room_graph_t *graph;
+    room_graph_stats_t graphStats;
+    tilemap_t *tilemap;
+    validation_t validation;
+    int separationIters;         // separateRooms iterations, 0 on a cache hit
+    int overused;                // tiles still overused after routing, 0 without routing or on a cache hit
+    int cached;                  // generate through fixRoomEdges came from the cache
+    size_t scratchPeak;          // most scratch arena bytes the stages held at once
+} pipeline_result_t;
+
+/*
+ * Runs every stage, prints the stage timings when params->verbose is set.
+ * With a cache, the stages up to fixRoomEdges are loaded from it when
+ * possible and stored in it otherwise. cache may be NULL.
+ */
+void runPipeline(gen_params_t *params, int useRouting, dungeon_cache_t *cache, pipeline_result_t *result);
+
+/*
+ * runPipeline in three steps, for schedulers that interleave the steps of
+ * different dungeons: layout (cache lookup, generate, separateRooms),
+ * hallways (constructHallways and routing, the serial Delaunay and MST work,
+ * skipped on a cache hit) and finish (mergeHallways through validation).
+ * The steps of one result run in that order, one at a time, on any threads.
+ * Once params->control is cancelled the running stage stops at its next check,
+ * the rest of the step and the later steps are skipped, and whatever wasn't
+ * built yet (mst_dela, graph, tilemap) stays NULL.
+ */
+void pipelineLayout(gen_params_t *params, int useRouting, dungeon_cache_t *cache, pipeline_result_t *result);
+void pipelineHallways(gen_params_t *params, int useRouting, dungeon_cache_t *cache, pipeline_result_t *result);
+void pipelineFinish(gen_params_t *params, int useRouting, dungeon_cache_t *cache, pipeline_result_t *result);
+/* Frees everything the steps allocated, also after a cancelled generation */
+void freePipelineResult(pipeline_result_t *result);
+
+/*
+ * Prints the bounding area, room graph, tile map and validation lines for a
+ * dungeon, or a single line saying it stopped if it never got a tile map
+ */
+void printPipelineSummary(const pipeline_result_t *result);
+
+/* Receives each finished dungeon, calls are serialized but arrive in completion order */
+typedef void (*batch_sink_t)(int index, pipeline_result_t *result, void *ctx);
+
+/*
+ * Generates count dungeons with seeds params->seed .. params->seed + count - 1,
+ * one dungeon per thread with the stages running single threaded inside it.
+ * Each result is handed to sink and freed afterwards.
+ */
+void generateBatch(gen_params_t *params, int count, int useRouting, dungeon_cache_t *cache,
+                   batch_sink_t sink, void *ctx);
@@ -0,0 +1,133 @@
+/*
+ * Room placement
+ *
+ * Both even placements work from the cell spacing s = R * sqrt(pi / n), the
+ * side of the square each of n centers would own if they tiled the disc.
+ *
+ * The jittered placement puts center i at radius R * sqrt((i + 0.5) / n) and
+ * angle i times the golden angle, which spaces the points about s apart all
+ * over the disc, and then adds a uniform offset of up to PLACEMENT_JITTER * s / 2
+ * in each axis. Every room is placed independently, so it runs in parallel.
+ *
+ * The Poisson-disc placement is sequential: room i throws PLACEMENT_CANDIDATES
+ * uniform darts at the disc and takes the first one at least
+ * PLACEMENT_MIN_DIST * s away from every earlier center, looked up in a grid
+ * of cells that size. When every dart misses it takes the dart farthest from
+ * its nearest neighbour, so exactly n rooms are always placed.
+ *
+ * All darts and offsets come from the counter-based generator, so both modes
+ * give the same rooms for a seed on any thread count.
+ */
+
+#include <cmath>
+#include <cstdlib>
+#include <cstdio>
+#include <cstdint>
+#include <limits>
+#include <algorithm>
+#include <omp.h>
+
+#include "generate.h"
+#include "rng.h"
+#include "placement.h"
+#include "arena.h"
+
+#define GOLDEN_ANGLE 2.39996322972865332
+
+float placementRadius(gen_params_t *params, rectangle_t *rooms, int numRooms) {
+    if (params->radius > 0)
+        return params->radius;
+    // sizes are whole tiles, so the integer sum is exact and thread-count independent
+    long long area = 0;
+    #pragma omp parallel for schedule(static) reduction(+:area)
+    for (int i = 0; i < numRooms; i++)
+        area += (long long)rooms[i].width * (long long)rooms[i].height;
+    return std::max(1.0f, (float)sqrt(area / (PLACEMENT_FILL * M_PI)));
+}
+
+static void placeJittered(rectangle_t *rooms, int numRooms, float radius, uint64_t seed) {
+    float spacing = radius * sqrt(M_PI / numRooms);
+    float jitter = PLACEMENT_JITTER * spacing;
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < numRooms; i++) {
+        float r = radius * sqrt((i + 0.5f) / numRooms);
+        float t = fmod(i * GOLDEN_ANGLE, 2 * M_PI);
+        float dx = (rngUniform(seed, i, RNG_STREAM_POSITION, 0) - 0.5) * jitter;
+        float dy = (rngUniform(seed, i, RNG_STREAM_POSITION, 1) - 0.5) * jitter;
+        rooms[i].center.x = round(r * cos(t) + dx);
+        rooms[i].center.y = round(r * sin(t) + dy);
+    }
+}
+
+// Squared distance from p to the nearest center in the 3x3 cells around it
+static float nearestSquared(point_t p, rectangle_t *rooms, int *head, int *next,
+                            int gridSize, float cellSize, float radius) {
+    int gx = (int)((p.x + radius) / cellSize);
+    int gy = (int)((p.y + radius) / cellSize);
+    float best = std::numeric_limits<float>::infinity();
+    for (int y = std::max(gy - 1, 0); y <= std::min(gy + 1, gridSize - 1); y++) {
+        for (int x = std::max(gx - 1, 0); x <= std::min(gx + 1, gridSize - 1); x++) {
+            for (int j = head[y * gridSize + x]; j >= 0; j = next[j]) {
+                float dx = rooms[j].center.x - p.x;
+                float dy = rooms[j].center.y - p.y;
+                best = std::min(best, dx * dx + dy * dy);
+            }
+        }
+    }
+    return best;
+}
+
+static void placePoisson(rectangle_t *rooms, int numRooms, float radius, uint64_t seed) {
+    float minDist = PLACEMENT_MIN_DIST * radius * sqrt(M_PI / numRooms);
+    // centers are rounded, so they can land up to half a tile outside the disc
+    float cellSize = std::max(minDist, 1.0f);
+    int gridSize = (int)ceil((2 * radius + 2) / cellSize) + 1;
+    arena_t *arena = scratchArena();
+    arena_mark_t mark = arenaMark(arena);
+    int *head = (int *)arenaAlloc(arena, sizeof(int) * gridSize * gridSize);
+    int *next = (int *)arenaAlloc(arena, sizeof(int) * numRooms);
+    std::fill(head, head + gridSize * gridSize, -1);
+
+    for (int i = 0; i < numRooms; i++) {
+        point_t best = {0, 0};
+        float bestDist = -1;
+        for (int k = 0; k < PLACEMENT_CANDIDATES; k++) {
+            float r = radius * sqrt(rngUniform(seed, i, RNG_STREAM_POSITION, 2 * k));
+            float t = 2 * M_PI * rngUniform(seed, i, RNG_STREAM_POSITION, 2 * k + 1);
+            point_t p;
+            p.x = round(r * cos(t));
+            p.y = round(r * sin(t));
+            float dist = nearestSquared(p, rooms, head, next, gridSize, cellSize, radius + 1);
+            if (dist > bestDist) {
+                bestDist = dist;
+                best = p;
+            }
+            if (dist >= minDist * minDist)
+                break;
+        }
+        rooms[i].center = best;
+        int cell = (int)((best.y + radius + 1) / cellSize) * gridSize + (int)((best.x + radius + 1) / cellSize);
+        next[i] = head[cell];
+        head[cell] = i;
+    }
+    arenaRelease(arena, mark);
+}
+
+void placeRooms(gen_params_t *params, rectangle_t *rooms, int numRooms) {
+    float radius = placementRadius(params, rooms, numRooms);
+    switch (params->placement) {
+    case PLACEMENT_JITTERED:
+        placeJittered(rooms, numRooms, radius, params->seed);
+        break;
+    case PLACEMENT_POISSON:
+        placePoisson(rooms, numRooms, radius, params->seed);
+        break;
+    default:
+        #pragma omp parallel for schedule(static)
+        for (int i = 0; i < numRooms; i++)
+            rooms[i].center = getRandomPointInCircle(radius, params->seed, i);
+        break;
+    }
+    if (params->verbose)
+        printf("Placed %d rooms in a disc of radius %.1f\n", numRooms, radius);
+}
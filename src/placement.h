@@ -0,0 +1,29 @@
+/*
+ * Initial room placement.
+ *
+ * separateRooms pushes overlapping rooms apart one tile per iteration, so the
+ * number of iterations it needs is set by how crowded the initial placement
+ * is. PLACEMENT_DISC is the original placement, which piles the rooms up in
+ * the middle of the disc. The other modes spread the centers evenly over the
+ * disc so that rooms start out mostly apart:
+ *
+ *   PLACEMENT_JITTERED  one center per cell of a sunflower (Vogel spiral)
+ *                       layout, moved by a random offset within its cell
+ *   PLACEMENT_POISSON   Poisson-disc dart throwing, every center keeps a
+ *                       minimum distance from the ones placed before it
+ *
+ * With radius <= 0 the disc is sized so the rooms cover PLACEMENT_FILL of it.
+ *
+ * Include after generate.h.
+ */
+
+#define PLACEMENT_FILL       0.5f  // room area / disc area for an auto-sized disc
+#define PLACEMENT_JITTER     0.5f  // jittered offset, as a fraction of the cell spacing
+#define PLACEMENT_MIN_DIST   0.75f // Poisson-disc minimum distance, as a fraction of the cell spacing
+#define PLACEMENT_CANDIDATES 30    // Poisson-disc darts per room before taking the best one
+
+/* Radius the rooms are placed in, params->radius or the auto-sized radius */
+float placementRadius(gen_params_t *params, rectangle_t *rooms, int numRooms);
+
+/* Sets the centers of rooms whose sizes are already set, according to params->placement */
+void placeRooms(gen_params_t *params, rectangle_t *rooms, int numRooms);
@@ -0,0 +1,316 @@
+/*
+ * Work-stealing pool
+ *
+ * Each thread's deque is a std::deque under its own mutex. The owner takes
+ * the newest task (the smallest piece, still hot in its cache) and thieves
+ * the oldest. Threads outside the pool run their forks and loops inline, so
+ * poolThreadIndex() stays unique among the threads working on one call.
+ * Idle workers sleep on a condition variable until a fork makes queued
+ * non-zero. A joining thread runs tasks inside its group while there are any.
+ * Otherwise the group's remaining tasks are running on other threads, and the
+ * joiner sleeps on a second condition variable until one of them forks or
+ * finishes, which bumps epoch. Finishing tasks only take the lock when a
+ * joiner is asleep.
+ */
+
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include <condition_variable>
+#include <omp.h>
+
+#include "pool.h"
+
+typedef struct {
+    void (*fn)(void *ctx);         // NULL for a piece of a parallelFor, ctx is its pool_loop_t
+    void *ctx;
+    pool_group_t *group;
+    int begin;                     // the piece's range
+    int end;
+} pool_task_t;
+
+// One parallelFor call, on its caller's stack until the join
+typedef struct {
+    int grain;
+    pool_range_fn_t fn;
+    void *ctx;
+    pool_group_t *group;
+} pool_loop_t;
+
+typedef struct {
+    std::mutex lock;
+    std::deque<pool_task_t> tasks;
+} pool_deque_t;
+
+struct pool_t {
+    int runtime;
+    int threads;
+    pool_deque_t *deques;          // one per thread
+    std::vector<std::thread> workers;
+    std::atomic<int> queued;       // tasks sitting in deques
+    std::atomic<bool> stop;
+    std::mutex sleepLock;
+    std::condition_variable wake;  // idle workers
+    std::condition_variable moved; // sleeping joiners
+    std::atomic<unsigned> epoch;   // bumped under sleepLock by every fork and finished task
+    std::atomic<int> joiners;      // joiners asleep or about to sleep on moved
+
+    pool_t() : runtime(POOL_RUNTIME_STEALING), threads(0), deques(NULL), queued(0), stop(false), epoch(0), joiners(0) {}
+
+    // joins the workers at exit
+    ~pool_t() {
+        {
+            std::lock_guard<std::mutex> guard(sleepLock);
+            stop = true;
+        }
+        wake.notify_all();
+        for (size_t i = 0; i < workers.size(); i++)
+            workers[i].join();
+        delete[] deques;
+    }
+};
+
+static pool_t pool;
+static std::once_flag poolStarted;
+static thread_local int threadIndex = -1;              // -1 outside the pool
+static thread_local pool_group_t *currentGroup = NULL;  // group of the task this thread runs
+static pool_group_t detached;                           // group of poolDetach tasks, never joined
+
+static void workerLoop(int index);
+
+static void startPool(int threads, int runtime) {
+    pool.runtime = runtime;
+    pool.threads = threads > 0 ? threads : omp_get_max_threads();
+    pool.deques = new pool_deque_t[pool.threads];
+    threadIndex = 0;
+    if (runtime == POOL_RUNTIME_STEALING) {
+        for (int i = 1; i < pool.threads; i++)
+            pool.workers.push_back(std::thread(workerLoop, i));
+    }
+}
+
+void initPool(int threads, int runtime) {
+    std::call_once(poolStarted, startPool, threads, runtime);
+}
+
+static void ensurePool() {
+    if (!pool.deques)
+        initPool(0, POOL_RUNTIME_STEALING);
+}
+
+int poolThreads() {
+    ensurePool();
+    return pool.threads;
+}
+
+int poolRuntime() {
+    ensurePool();
+    return pool.runtime;
+}
+
+int poolThreadIndex() {
+    if (poolRuntime() == POOL_RUNTIME_OPENMP)
+        return omp_get_thread_num();
+    return threadIndex >= 0 ? threadIndex : 0;
+}
+
+void poolGroupInit(pool_group_t *group) {
+    group->pending = 0;
+    group->parent = currentGroup;
+}
+
+// Whether task belongs to group or to a group nested inside it
+static bool within(pool_task_t *task, pool_group_t *group) {
+    for (pool_group_t *g = task->group; g; g = g->parent)
+        if (g == group)
+            return true;
+    return false;
+}
+
+// Takes a task from deque d, the newest one from its owner and the oldest
+// one otherwise, restricted to group unless group is NULL
+static bool takeFrom(int d, bool owner, pool_group_t *group, pool_task_t *out) {
+    pool_deque_t *deque = &pool.deques[d];
+    std::lock_guard<std::mutex> guard(deque->lock);
+    std::deque<pool_task_t> &tasks = deque->tasks;
+    if (tasks.empty())
+        return false;
+    if (!group) {
+        *out = owner ? tasks.back() : tasks.front();
+        if (owner)
+            tasks.pop_back();
+        else
+            tasks.pop_front();
+        pool.queued--;
+        return true;
+    }
+    int n = (int)tasks.size();
+    for (int k = 0; k < n; k++) {
+        int i = owner ? n - 1 - k : k;
+        if (within(&tasks[i], group)) {
+            *out = tasks[i];
+            tasks.erase(tasks.begin() + i);
+            pool.queued--;
+            return true;
+        }
+    }
+    return false;
+}
+
+// The calling thread's own deque first, then the others starting after it
+static bool takeTask(pool_group_t *group, pool_task_t *out) {
+    int self = threadIndex;
+    if (takeFrom(self, true, group, out))
+        return true;
+    for (int k = 1; k < pool.threads; k++) {
+        if (takeFrom((self + k) % pool.threads, false, group, out))
+            return true;
+    }
+    return false;
+}
+
+static bool inlineOnly() {
+    return pool.runtime == POOL_RUNTIME_OPENMP || pool.threads == 1 || threadIndex < 0;
+}
+
+int poolInline() {
+    ensurePool();
+    return inlineOnly();
+}
+
+// Wakes the sleeping joiners, if any, to look at the deques and their groups again
+static void notifyJoiners() {
+    if (pool.joiners == 0)
+        return;
+    {
+        std::lock_guard<std::mutex> guard(pool.sleepLock);
+        pool.epoch++;
+    }
+    pool.moved.notify_all();
+}
+
+static void runRange(pool_loop_t *loop, int begin, int end);
+
+static void runTask(pool_task_t *task) {
+    pool_group_t *outer = currentGroup;
+    currentGroup = task->group;
+    if (task->fn)
+        task->fn(task->ctx);
+    else
+        runRange((pool_loop_t *)task->ctx, task->begin, task->end);
+    currentGroup = outer;
+    task->group->pending--;
+    notifyJoiners();
+}
+
+static void workerLoop(int index) {
+    threadIndex = index;
+    // stages' OpenMP loops run single threaded on pool threads
+    omp_set_num_threads(1);
+    while (true) {
+        pool_task_t task;
+        if (takeTask(NULL, &task)) {
+            runTask(&task);
+            continue;
+        }
+        std::unique_lock<std::mutex> sleep(pool.sleepLock);
+        pool.wake.wait(sleep, [] { return pool.stop || pool.queued > 0; });
+        if (pool.stop)
+            return;
+    }
+}
+
+// Queues task on deque d and wakes a sleeping worker and the sleeping joiners
+static void pushTask(int d, pool_task_t task) {
+    {
+        std::lock_guard<std::mutex> guard(pool.deques[d].lock);
+        pool.deques[d].tasks.push_back(task);
+        pool.queued++;
+    }
+    {
+        std::lock_guard<std::mutex> guard(pool.sleepLock);
+        pool.epoch++;
+    }
+    pool.wake.notify_one();
+    if (pool.joiners > 0)
+        pool.moved.notify_all();
+}
+
+void poolFork(pool_group_t *group, void (*fn)(void *ctx), void *ctx) {
+    ensurePool();
+    pool_task_t task = {fn, ctx, group, 0, 0};
+    group->pending++;
+    if (inlineOnly()) {
+        runTask(&task);
+        return;
+    }
+    pushTask(threadIndex, task);
+}
+
+int poolDetach(void (*fn)(void *ctx), void *ctx) {
+    ensurePool();
+    if (pool.runtime == POOL_RUNTIME_OPENMP || pool.threads == 1)
+        return 0;
+    pool_task_t task = {fn, ctx, &detached, 0, 0};
+    detached.pending++;
+    // from outside the pool the task goes on thread 0's deque for the workers to steal
+    pushTask(threadIndex >= 0 ? threadIndex : 0, task);
+    return 1;
+}
+
+void poolJoin(pool_group_t *group) {
+    if (inlineOnly())
+        return;
+    while (group->pending > 0) {
+        // anything forked or finished after this shows up as a new epoch
+        unsigned seen = pool.epoch;
+        pool_task_t task;
+        if (takeTask(group, &task)) {
+            runTask(&task);
+            continue;
+        }
+        std::unique_lock<std::mutex> sleep(pool.sleepLock);
+        pool.joiners++;
+        pool.moved.wait(sleep, [group, seen] { return group->pending == 0 || pool.epoch != seen; });
+        pool.joiners--;
+    }
+}
+
+// Forks the upper half until the range is down to the grain, then runs it.
+// The halves travel in their tasks, so splitting allocates nothing.
+static void runRange(pool_loop_t *loop, int begin, int end) {
+    while (end - begin > loop->grain) {
+        int mid = begin + (end - begin) / 2;
+        pool_task_t upper = {NULL, loop, loop->group, mid, end};
+        loop->group->pending++;
+        pushTask(threadIndex, upper);
+        end = mid;
+    }
+    loop->fn(begin, end, loop->ctx);
+}
+
+void parallelFor(int begin, int end, int grain, pool_range_fn_t fn, void *ctx) {
+    if (end <= begin)
+        return;
+    grain = std::max(grain, 1);
+    ensurePool();
+    if (pool.runtime == POOL_RUNTIME_OPENMP) {
+        int chunks = (end - begin + grain - 1) / grain;
+        int threads = std::min(pool.threads, omp_get_max_threads());
+        #pragma omp parallel for schedule(dynamic, 1) num_threads(threads)
+        for (int c = 0; c < chunks; c++)
+            fn(begin + c * grain, std::min(begin + (c + 1) * grain, end), ctx);
+        return;
+    }
+    if (inlineOnly() || end - begin <= grain) {
+        fn(begin, end, ctx);
+        return;
+    }
+    pool_group_t group;
+    poolGroupInit(&group);
+    pool_loop_t loop = {grain, fn, ctx, &group};
+    runRange(&loop, begin, end);
+    poolJoin(&group);
+}
@@ -0,0 +1,90 @@
+/*
+ * Parallel runtime for the stages.
+ *
+ * Irregular work (overlap scans, BFS frontiers, routing jobs, strips, whole
+ * dungeons in a batch) goes through parallelFor and fork/join instead of
+ * OpenMP worksharing. The default runtime is a work-stealing pool sized once
+ * per process: every thread has its own deque, pushes and pops its own
+ * tasks at the back, and steals from the front of the others' deques when
+ * it runs dry. parallelFor splits its range in halves down to the grain, so
+ * a thief always takes the biggest piece left. A thread waiting in poolJoin
+ * runs tasks of the group it waits for (and their subtasks) meanwhile, so
+ * nested parallelism such as the stages of a dungeon inside a batch neither
+ * deadlocks nor oversubscribes. A waiting thread never picks up unrelated
+ * work, so a stage's scratch arena can't be touched by another dungeon while
+ * the stage waits.
+ *
+ * With POOL_RUNTIME_OPENMP, parallelFor is an omp parallel for over
+ * grain-sized chunks with a dynamic schedule, and poolFork runs the task on
+ * the spot. That is what the stages did before the pool.
+ *
+ * The regular loops with static schedules (size sampling, placement, SoA
+ * conversion, main room lookups, separateRooms' steps) stay on OpenMP
+ * worksharing under either runtime, and pool threads run them single
+ * threaded.
+ */
+
+#include <atomic>
+
+#define POOL_RUNTIME_STEALING 0
+#define POOL_RUNTIME_OPENMP   1
+
+/*
+ * Starts the pool with threads threads counting the caller, which joins the
+ * pool as thread 0. threads <= 0 takes omp_get_max_threads(). Call once per
+ * process before the first parallel call, or the first call starts the
+ * stealing pool with the default size from the thread that makes it.
+ */
+void initPool(int threads, int runtime);
+int poolThreads();
+int poolRuntime();
+/* Whether poolFork and parallelFor run inline on the calling thread */
+int poolInline();
+
+/*
+ * Index of the calling thread in [0, poolThreads()). Threads outside the pool
+ * get 0 and run poolFork and parallelFor inline.
+ */
+int poolThreadIndex();
+
+typedef struct pool_group_t {
+    std::atomic<int> pending;      // forked tasks not finished yet
+    struct pool_group_t *parent;   // group of the task that created this one
+} pool_group_t;
+
+void poolGroupInit(pool_group_t *group);
+/* Runs fn(ctx) on some pool thread as part of group */
+void poolFork(pool_group_t *group, void (*fn)(void *ctx), void *ctx);
+/* Returns once every task forked into group has finished */
+void poolJoin(pool_group_t *group);
+
+/*
+ * Queues fn(ctx) to run on a pool worker in the background and returns 1
+ * without waiting for it. Nothing ever joins a detached task, and a thread
+ * waiting in poolJoin never picks one up. Returns 0 and runs nothing when no
+ * worker could take it (the OpenMP runtime or a one-thread pool).
+ */
+int poolDetach(void (*fn)(void *ctx), void *ctx);
+
+typedef void (*pool_range_fn_t)(int begin, int end, void *ctx);
+
+/*
+ * Calls fn on disjoint subranges at most grain long that cover [begin, end)
+ * and returns once all of them are done. fn must not use the scratch arena,
+ * except in the batch drivers, whose bodies run whole pipeline steps and are
+ * never nested inside a stage.
+ */
+void parallelFor(int begin, int end, int grain, pool_range_fn_t fn, void *ctx);
+
+template <typename F>
+static void poolRangeBody(int first, int last, void *ctx) {
+    F *body = (F *)ctx;
+    for (int i = first; i < last; i++)
+        (*body)(i);
+}
+
+/* parallelFor calling f(i) for every i */
+template <typename F>
+static inline void parallelFor(int begin, int end, int grain, F f) {
+    parallelFor(begin, end, grain, &poolRangeBody<F>, &f);
+}
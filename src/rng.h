@@ -0,0 +1,36 @@
+/*
+ * Counter-based random numbers for the generation pipeline.
+ *
+ * Every value is a pure function of (seed, index, stream, counter), built
+ * from SplitMix64 finalizers, so rooms and edges can draw their numbers in
+ * any order and on any thread and still get the same dungeon for a seed.
+ * index is the room or edge number, stream separates the different things
+ * drawn for it, and counter numbers successive draws (e.g. rejection retries).
+ */
+
+#include <cstdint>
+
+// streams
+#define RNG_STREAM_POSITION   0
+#define RNG_STREAM_WIDTH      1
+#define RNG_STREAM_HEIGHT     2
+#define RNG_STREAM_EXTRA_EDGE 3
+#define RNG_STREAM_CHUNK      4
+#define RNG_STREAM_PORTAL     5
+
+static inline uint64_t splitmix64(uint64_t x) {
+    x += 0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+static inline uint64_t rngBits(uint64_t seed, uint64_t index, uint64_t stream, uint64_t counter) {
+    uint64_t key = splitmix64(seed ^ (stream * 0xD1B54A32D192ED03ULL));
+    return splitmix64(splitmix64(key ^ index) ^ counter);
+}
+
+// uniform in [0, 1), 53 random bits
+static inline double rngUniform(uint64_t seed, uint64_t index, uint64_t stream, uint64_t counter) {
+    return (rngBits(seed, index, stream, counter) >> 11) * (1.0 / 9007199254740992.0);
+}
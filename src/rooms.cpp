@@ -0,0 +1,90 @@
+/*
+ * Structure-of-arrays rooms
+ *
+ * All five arrays come out of one arena block, each one padded to a whole
+ * number of ROOM_SOA_ALIGN units so every array starts aligned.
+ */
+
+#include <cstdlib>
+#include <omp.h>
+
+#include "generate.h"
+#include "geometry.h"
+#include "rooms.h"
+#include "arena.h"
+#include "pool.h"
+
+static_assert(ARENA_ALIGN % ROOM_SOA_ALIGN == 0, "arena blocks must be aligned for the SoA arrays");
+
+static size_t padded(size_t bytes) {
+    return (bytes + ROOM_SOA_ALIGN - 1) / ROOM_SOA_ALIGN * ROOM_SOA_ALIGN;
+}
+
+room_soa_t *roomsToSoA(rectangle_t *rooms, int numRooms) {
+    arena_t *arena = scratchArena();
+    room_soa_t *soa = (room_soa_t *)arenaAlloc(arena, sizeof(room_soa_t));
+    size_t floats = padded(sizeof(float) * numRooms);
+    size_t chars = padded(numRooms);
+    char *base = (char *)arenaAlloc(arena, floats * 4 + chars);
+    soa->numRooms = numRooms;
+    soa->x = (float *)base;
+    soa->y = (float *)(base + floats);
+    soa->hw = (float *)(base + floats * 2);
+    soa->hh = (float *)(base + floats * 3);
+    soa->status = base + floats * 4;
+
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < numRooms; i++) {
+        soa->x[i] = rooms[i].center.x;
+        soa->y[i] = rooms[i].center.y;
+        soa->hw[i] = rooms[i].width / 2;
+        soa->hh[i] = rooms[i].height / 2;
+        soa->status[i] = rooms[i].status;
+    }
+    return soa;
+}
+
+// Field by field rather than through roomAt, so the padding after status
+// keeps the zeros the rooms were calloc'd with. Rooms go to dungeon files
+// and the cache as raw structs.
+void roomsFromSoA(room_soa_t *soa, rectangle_t *rooms) {
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < soa->numRooms; i++) {
+        rooms[i].center.x = soa->x[i];
+        rooms[i].center.y = soa->y[i];
+        rooms[i].width = soa->hw[i] * 2;
+        rooms[i].height = soa->hh[i] * 2;
+        rooms[i].status = soa->status[i];
+    }
+}
+
+// Each row only tests the rooms after it, the inner loop runs as one SIMD
+// sweep over the arrays and the rows stop early once an overlap is found
+int anyOverlappingSoA(room_soa_t *soa) {
+    int numRooms = soa->numRooms;
+    const float *x = soa->x;
+    const float *y = soa->y;
+    const float *hw = soa->hw;
+    const float *hh = soa->hh;
+    int found = 0;
+    parallelFor(0, numRooms, 64, [&](int i) {
+        int done;
+        #pragma omp atomic read
+        done = found;
+        if (done)
+            return;
+        float xi = x[i];
+        float yi = y[i];
+        float hwi = hw[i];
+        float hhi = hh[i];
+        int hit = 0;
+        #pragma omp simd reduction(|:hit)
+        for (int j = i + 1; j < numRooms; j++)
+            hit |= spansOverlap(xi, hwi, x[j], hw[j]) & spansOverlap(yi, hhi, y[j], hh[j]);
+        if (hit) {
+            #pragma omp atomic write
+            found = 1;
+        }
+    });
+    return found;
+}
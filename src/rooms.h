@@ -0,0 +1,49 @@
+/*
+ * Structure-of-arrays room storage.
+ *
+ * rectangle_t keeps a room's center, size and status together in a padded
+ * 20-byte struct, but the separation and overlap loops only read centers and
+ * extents. room_soa_t holds each field in its own ROOM_SOA_ALIGN aligned
+ * array, with half extents instead of sizes, so those loops stream just the
+ * data they use and the inner loops vectorize. Stages convert in and out with
+ * roomsToSoA / roomsFromSoA, roomAt gives the AoS view of one room for code
+ * written against rectangle_t. The SoA copy lives in the calling thread's
+ * scratch arena (see arena.h) and goes away with the caller's arenaRelease.
+ *
+ * Include after geometry.h.
+ */
+
+#define ROOM_SOA_ALIGN 64
+
+typedef struct {
+    int numRooms;
+    float *x;      // centers
+    float *y;
+    float *hw;     // half widths
+    float *hh;     // half heights
+    char *status;
+} room_soa_t;
+
+room_soa_t *roomsToSoA(rectangle_t *rooms, int numRooms);
+
+/* Writes the centers, sizes and status back to numRooms AoS rooms */
+void roomsFromSoA(room_soa_t *soa, rectangle_t *rooms);
+
+static inline rectangle_t roomAt(room_soa_t *soa, int i) {
+    rectangle_t room;
+    room.center.x = soa->x[i];
+    room.center.y = soa->y[i];
+    room.width = soa->hw[i] * 2;
+    room.height = soa->hh[i] * 2;
+    room.status = soa->status[i];
+    return room;
+}
+
+/* Same test as isOverlapping for i != j, touching edges count as overlapping */
+static inline int soaOverlapping(room_soa_t *soa, int i, int j) {
+    return spansOverlap(soa->x[i], soa->hw[i], soa->x[j], soa->hw[j]) &&
+           spansOverlap(soa->y[i], soa->hh[i], soa->y[j], soa->hh[j]);
+}
+
+/* Whether any two of the rooms overlap */
+int anyOverlappingSoA(room_soa_t *soa);
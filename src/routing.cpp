@@ -0,0 +1,356 @@
+/*
+ * Congestion-aware A* hallway routing
+ *
+ * Edges are routed in fixed-size batches: the edges of a batch are searched
+ * in parallel against the same congestion snapshot, then committed in order,
+ * so the result does not depend on the number of threads. After the initial
+ * routing, tiles used by more than one corridor get their history cost raised
+ * and every route through them is ripped up and rerouted, for up to
+ * maxPasses passes or until the dungeon's params.control stops them.
+ *
+ * Tiles inside main rooms are never congested: corridors are supposed to meet
+ * there. Jump point search was not used because it only applies to uniform
+ * cost grids, which the congestion costs are not.
+ *
+ * The grid and the edge lists live in the scratch arena. The A* buffers and
+ * open list are kept per thread across dungeons and only grow, since they are
+ * sized by the search window inside the parallel batches. The per-edge tile
+ * paths stay on the heap for the same reason: their length is only known once
+ * the search inside the batch has found them.
+ */
+
+#include <cmath>
+#include <cstdlib>
+#include <cstdio>
+#include <climits>
+#include <vector>
+#include <functional>
+#include <algorithm>
+
+#include "generate.h"
+#include "geometry.h"
+#include "routing.h"
+#include "control.h"
+#include "pool.h"
+#include "arena.h"
+
+// edges searched against the same congestion snapshot
+#define ROUTE_BATCH 32
+
+typedef struct {
+    int left;    // inclusive tile bounds, world coordinates
+    int top;
+    int right;
+    int bottom;
+} tile_box_t;
+
+typedef struct {
+    int originX;
+    int originY;
+    int width;
+    int height;
+    unsigned char *blocked;  // tile lies in a main room
+    int *usage;              // corridors currently on the tile
+    float *history;          // accumulated overuse cost
+} route_grid_t;
+
+typedef std::pair<float, int> open_entry_t;
+
+// Per-thread A* buffers, entries are valid only when their stamp matches
+typedef struct {
+    std::vector<float> g;
+    std::vector<int> parent;
+    std::vector<int> seen;
+    std::vector<int> closed;
+    std::vector<open_entry_t> open;  // binary min-heap
+    int stamp;
+} search_ws_t;
+
+// reused by every search on the thread
+static thread_local search_ws_t threadWorkspace;
+
+static const int DIR_X[4] = {1, -1, 0, 0};
+static const int DIR_Y[4] = {0, 0, 1, -1};
+
+void defaultRoutingParams(routing_params_t *params) {
+    params->maxPasses = 8;
+    params->margin = 8;
+    params->bendCost = 2.0f;
+    params->presentFactor = 4.0f;
+    params->historyIncrement = 1.0f;
+}
+
+static tile_box_t roomBox(rectangle_t *room) {
+    float left, top, right, bottom;
+    tileSpan(room->center.x, room->width, &left, &right);
+    tileSpan(room->center.y, room->height, &top, &bottom);
+    tile_box_t b = {(int)left, (int)top, (int)right, (int)bottom};
+    return b;
+}
+
+// Tile (x, y) as a point box against the room's tiles, in half-tile units
+static int inBox(tile_box_t *b, int x, int y) {
+    int center[2] = {b->left + b->right, b->top + b->bottom};
+    int half[2] = {b->right - b->left, b->bottom - b->top};
+    int point[2] = {2 * x, 2 * y};
+    int none[2] = {0, 0};
+    return boxesOverlap<int, 2>(center, half, point, none);
+}
+
+static float tileCost(route_grid_t *grid, int t, routing_params_t *params) {
+    if (grid->blocked[t])
+        return 1.0f;
+    return (1.0f + grid->history[t]) * (1.0f + params->presentFactor * grid->usage[t]);
+}
+
+// A* from (sx, sy) to (tx, ty) inside a window around both endpoint rooms.
+// path receives grid tile indices from start to goal.
+static int searchRoute(route_grid_t *grid, routing_params_t *params, tile_box_t src, tile_box_t dest,
+                       int sx, int sy, int tx, int ty, std::vector<int> *path) {
+    search_ws_t *ws = &threadWorkspace;
+    int wl = std::max(std::min(std::min(src.left, dest.left), std::min(sx, tx)) - params->margin, grid->originX);
+    int wt = std::max(std::min(std::min(src.top, dest.top), std::min(sy, ty)) - params->margin, grid->originY);
+    int wr = std::min(std::max(std::max(src.right, dest.right), std::max(sx, tx)) + params->margin,
+                      grid->originX + grid->width - 1);
+    int wb = std::min(std::max(std::max(src.bottom, dest.bottom), std::max(sy, ty)) + params->margin,
+                      grid->originY + grid->height - 1);
+    int ww = wr - wl + 1;
+    int wh = wb - wt + 1;
+    size_t numStates = (size_t)ww * wh * 4;
+    // the buffers outlive the dungeon, so the stamp wraps eventually
+    if (ws->g.size() < numStates || ws->stamp == INT_MAX) {
+        ws->g.resize(std::max(ws->g.size(), numStates));
+        ws->parent.resize(ws->g.size());
+        ws->seen.assign(ws->g.size(), 0);
+        ws->closed.assign(ws->g.size(), 0);
+        ws->stamp = 0;
+    }
+    ws->stamp += 1;
+    int stamp = ws->stamp;
+
+    std::vector<open_entry_t> &open = ws->open;
+    std::greater<open_entry_t> later;
+    open.clear();
+
+    int startLocal = (sy - wt) * ww + (sx - wl);
+    for (int d = 0; d < 4; d++) {
+        int s = startLocal * 4 + d;
+        ws->g[s] = 0.0f;
+        ws->parent[s] = -1;
+        ws->seen[s] = stamp;
+        open.push_back(open_entry_t((float)(abs(tx - sx) + abs(ty - sy)), s));
+        std::push_heap(open.begin(), open.end(), later);
+    }
+
+    int goal = -1;
+    while (!open.empty()) {
+        std::pop_heap(open.begin(), open.end(), later);
+        int s = open.back().second;
+        open.pop_back();
+        if (ws->closed[s] == stamp)
+            continue;
+        ws->closed[s] = stamp;
+
+        int local = s / 4;
+        int dir = s % 4;
+        int x = wl + local % ww;
+        int y = wt + local / ww;
+        if (x == tx && y == ty) {
+            goal = s;
+            break;
+        }
+
+        for (int d = 0; d < 4; d++) {
+            int nx = x + DIR_X[d];
+            int ny = y + DIR_Y[d];
+            if (nx < wl || nx > wr || ny < wt || ny > wb)
+                continue;
+            int t = (ny - grid->originY) * grid->width + (nx - grid->originX);
+            if (grid->blocked[t] && !inBox(&src, nx, ny) && !inBox(&dest, nx, ny))
+                continue;
+            int ns = ((ny - wt) * ww + (nx - wl)) * 4 + d;
+            if (ws->closed[ns] == stamp)
+                continue;
+            float g = ws->g[s] + tileCost(grid, t, params) + (d != dir ? params->bendCost : 0.0f);
+            if (ws->seen[ns] == stamp && ws->g[ns] <= g)
+                continue;
+            ws->seen[ns] = stamp;
+            ws->g[ns] = g;
+            ws->parent[ns] = s;
+            open.push_back(open_entry_t(g + abs(tx - nx) + abs(ty - ny), ns));
+            std::push_heap(open.begin(), open.end(), later);
+        }
+    }
+
+    path->clear();
+    if (goal < 0)
+        return 0;
+    for (int s = goal; s != -1; s = ws->parent[s]) {
+        int local = s / 4;
+        int x = wl + local % ww;
+        int y = wt + local / ww;
+        path->push_back((y - grid->originY) * grid->width + (x - grid->originX));
+    }
+    std::reverse(path->begin(), path->end());
+    return 1;
+}
+
+// Straight / L-shaped fallback for edges A* could not connect inside its window
+static void lShapedRoute(route_grid_t *grid, int sx, int sy, int tx, int ty, std::vector<int> *path) {
+    path->clear();
+    int stepY = (ty > sy) ? 1 : -1;
+    for (int y = sy; y != ty; y += stepY)
+        path->push_back((y - grid->originY) * grid->width + (sx - grid->originX));
+    int stepX = (tx > sx) ? 1 : -1;
+    for (int x = sx; x != tx; x += stepX)
+        path->push_back((ty - grid->originY) * grid->width + (x - grid->originX));
+    path->push_back((ty - grid->originY) * grid->width + (tx - grid->originX));
+}
+
+static void commitRoute(route_grid_t *grid, std::vector<int> *path, int delta) {
+    for (size_t i = 0; i < path->size(); i++) {
+        int t = (*path)[i];
+        if (!grid->blocked[t])
+            grid->usage[t] += delta;
+    }
+}
+
+// Routes the given edges in batches, searching each batch in parallel
+static void routeEdges(route_grid_t *grid, routing_params_t *params, dungeon_t *dungeon, edge_t *edges,
+                       int *todo, int numTodo, std::vector< std::vector<int> > &paths) {
+    for (int b = 0; b < numTodo; b += ROUTE_BATCH) {
+        int batchSize = std::min(ROUTE_BATCH, numTodo - b);
+
+        parallelFor(0, batchSize, 1, [&](int k) {
+            int e = todo[b + k];
+            rectangle_t *srcRoom = &dungeon->rooms[edges[e].src];
+            rectangle_t *destRoom = &dungeon->rooms[edges[e].dest];
+            int sx = (int)floor(srcRoom->center.x);
+            int sy = (int)floor(srcRoom->center.y);
+            int tx = (int)floor(destRoom->center.x);
+            int ty = (int)floor(destRoom->center.y);
+            if (!searchRoute(grid, params, roomBox(srcRoom), roomBox(destRoom), sx, sy, tx, ty, &paths[e]))
+                lShapedRoute(grid, sx, sy, tx, ty, &paths[e]);
+        });
+
+        for (int k = 0; k < batchSize; k++)
+            commitRoute(grid, &paths[todo[b + k]], 1);
+    }
+}
+
+// Splits a tile path into maximal straight segments, written to out unless
+// it is NULL, returns how many
+static int pathSegments(route_grid_t *grid, std::vector<int> &path, int hallway, segment_t *out) {
+    int n = (int)path.size();
+    point_t segStart = {(float)(grid->originX + path[0] % grid->width), (float)(grid->originY + path[0] / grid->width)};
+    if (n == 1) {
+        if (out)
+            out[0] = {segStart, segStart, hallway};
+        return 1;
+    }
+    int count = 0;
+    for (int i = 1; i < n; i++) {
+        bool last = (i == n - 1);
+        bool turn = !last && (path[i + 1] - path[i] != path[i] - path[i - 1]);
+        if (last || turn) {
+            point_t p = {(float)(grid->originX + path[i] % grid->width), (float)(grid->originY + path[i] / grid->width)};
+            if (out)
+                out[count] = {segStart, p, hallway};
+            count += 1;
+            segStart = p;
+        }
+    }
+    return count;
+}
+
+int routeHallways(dungeon_t *dungeon, double_edge_t *mst_dela, routing_params_t *params) {
+    edge_t *edges = mst_dela->mst;
+    int numEdges = mst_dela->mst_edges;
+
+    // Grid covers every main room plus the search margin
+    route_grid_t grid;
+    int left = 0, top = 0, right = 0, bottom = 0;
+    for (int i = 0; i < dungeon->numMainRooms; i++) {
+        tile_box_t b = roomBox(&dungeon->rooms[dungeon->mainRoomIndices[i]]);
+        if (i == 0) {
+            left = b.left;
+            top = b.top;
+            right = b.right;
+            bottom = b.bottom;
+        }
+        left = std::min(left, b.left);
+        top = std::min(top, b.top);
+        right = std::max(right, b.right);
+        bottom = std::max(bottom, b.bottom);
+    }
+    grid.originX = left - params->margin;
+    grid.originY = top - params->margin;
+    grid.width = right - left + 1 + 2 * params->margin;
+    grid.height = bottom - top + 1 + 2 * params->margin;
+    size_t numTiles = (size_t)grid.width * grid.height;
+    arena_t *arena = scratchArena();
+    arena_mark_t mark = arenaMark(arena);
+    grid.blocked = (unsigned char *)arenaCalloc(arena, numTiles, sizeof(unsigned char));
+    grid.usage = (int *)arenaCalloc(arena, numTiles, sizeof(int));
+    grid.history = (float *)arenaCalloc(arena, numTiles, sizeof(float));
+
+    for (int i = 0; i < dungeon->numMainRooms; i++) {
+        tile_box_t b = roomBox(&dungeon->rooms[dungeon->mainRoomIndices[i]]);
+        for (int y = b.top; y <= b.bottom; y++)
+            for (int x = b.left; x <= b.right; x++)
+                grid.blocked[(size_t)(y - grid.originY) * grid.width + (x - grid.originX)] = 1;
+    }
+
+    std::vector< std::vector<int> > paths(numEdges);
+    int *todo = (int *)arenaAlloc(arena, sizeof(int) * numEdges);
+    int numTodo = numEdges;
+    for (int e = 0; e < numEdges; e++)
+        todo[e] = e;
+
+    routeEdges(&grid, params, dungeon, edges, todo, numTodo, paths);
+
+    // Negotiate: raise history on overused tiles, rip up and reroute their routes
+    int overused = 0;
+    for (int pass = 0; pass <= params->maxPasses; pass++) {
+        overused = 0;
+        for (size_t t = 0; t < numTiles; t++) {
+            if (grid.usage[t] > 1) {
+                grid.history[t] += params->historyIncrement;
+                overused += 1;
+            }
+        }
+        if (overused == 0 || pass == params->maxPasses || genShouldStop(dungeon->params.control, pass + 1))
+            break;
+
+        numTodo = 0;
+        for (int e = 0; e < numEdges; e++) {
+            for (size_t i = 0; i < paths[e].size(); i++) {
+                if (grid.usage[paths[e][i]] > 1) {
+                    todo[numTodo++] = e;
+                    break;
+                }
+            }
+        }
+        for (int k = 0; k < numTodo; k++)
+            commitRoute(&grid, &paths[todo[k]], -1);
+        routeEdges(&grid, params, dungeon, edges, todo, numTodo, paths);
+    }
+
+    int numSegments = 0;
+    for (int e = 0; e < numEdges; e++)
+        numSegments += pathSegments(&grid, paths[e], e, NULL);
+    segment_t *segments = (segment_t *)malloc(sizeof(segment_t) * (numSegments > 0 ? numSegments : 1));
+    int s = 0;
+    for (int e = 0; e < numEdges; e++)
+        s += pathSegments(&grid, paths[e], e, segments + s);
+    free(dungeon->segments);
+    dungeon->segments = segments;
+    dungeon->numSegments = numSegments;
+    // the L-shaped hallways no longer describe the corridors, the segments do
+    free(dungeon->hallways);
+    dungeon->hallways = NULL;
+    dungeon->numHallways = 0;
+
+    arenaRelease(arena, mark);
+    return overused;
+}
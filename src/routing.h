@@ -0,0 +1,27 @@
+/*
+ * Congestion-aware hallway routing.
+ *
+ * Optional replacement for the straight / L-shaped hallway segments built by
+ * constructHallways. Every hallway edge is routed on a tile grid with A*,
+ * where tile costs grow with how many other corridors use the tile (present
+ * congestion) and how often it was overused in earlier passes (history), in
+ * the style of negotiated-congestion VLSI routers. Main rooms other than the
+ * two endpoints are obstacles.
+ */
+
+typedef struct {
+    int maxPasses;           // rip-up-and-reroute passes after the initial routing
+    int margin;              // tiles the search window extends past the endpoint rooms
+    float bendCost;          // extra cost of a turn, keeps corridors straight
+    float presentFactor;     // cost multiplier per corridor already on a tile
+    float historyIncrement;  // added to a tile's history cost every pass it is overused
+} routing_params_t;
+
+void defaultRoutingParams(routing_params_t *params);
+
+/*
+ * Replaces dungeon->segments with routed segments, returns tiles still
+ * overused. The L-shaped hallways are dropped, numHallways becomes 0 and the
+ * segments' hallway field numbers the edges of mst_dela->mst.
+ */
+int routeHallways(dungeon_t *dungeon, double_edge_t *mst_dela, routing_params_t *params);
@@ -0,0 +1,82 @@
+/*
+ * Inverse-CDF size sampling
+ *
+ * Truncation: a draw x survives rounding to >= min exactly when
+ * x >= min - 0.5, so the normal is restricted to u in [p0, 1) with
+ * p0 = Phi((min - 0.5 - mean) / stddev). Table entry i holds the quantile at
+ * the middle of the i-th of SIZE_TABLE_ENTRIES equal slices of that range, and
+ * a uniform is mapped by linear interpolation between neighbouring entries.
+ * The tails beyond the first and last slice midpoints are clamped, which for
+ * 4096 entries is past 3.4 standard deviations.
+ */
+
+#include <cmath>
+#include <cstdlib>
+#include <cstdint>
+#include <algorithm>
+
+#include "generate.h"
+#include "rng.h"
+#include "sampler.h"
+
+// Inverse of the standard normal CDF (Acklam's rational approximation,
+// relative error below 1.2e-9)
+static double inverseNormalCDF(double p) {
+    static const double a[] = {-3.969683028665376e+01, 2.209460984245205e+02, -2.759285104469687e+02,
+                               1.383577518672690e+02, -3.066479806614716e+01, 2.506628277459239e+00};
+    static const double b[] = {-5.447609879822406e+01, 1.615858368580409e+02, -1.556989798598866e+02,
+                               6.680131188771972e+01, -1.328068155288572e+01};
+    static const double c[] = {-7.784894002430293e-03, -3.223964580411365e-01, -2.400758277161838e+00,
+                               -2.549732539343734e+00, 4.374664141464968e+00, 2.938163982698783e+00};
+    static const double d[] = {7.784695709041462e-03, 3.224671290700398e-01, 2.445134137142996e+00,
+                               3.754408661907416e+00};
+    const double pLow = 0.02425;
+
+    if (p < pLow) {
+        double q = sqrt(-2 * log(p));
+        return (((((c[0] * q + c[1]) * q + c[2]) * q + c[3]) * q + c[4]) * q + c[5]) /
+               ((((d[0] * q + d[1]) * q + d[2]) * q + d[3]) * q + 1);
+    }
+    if (p > 1 - pLow) {
+        double q = sqrt(-2 * log(1 - p));
+        return -(((((c[0] * q + c[1]) * q + c[2]) * q + c[3]) * q + c[4]) * q + c[5]) /
+                ((((d[0] * q + d[1]) * q + d[2]) * q + d[3]) * q + 1);
+    }
+    double q = p - 0.5;
+    double r = q * q;
+    return (((((a[0] * r + a[1]) * r + a[2]) * r + a[3]) * r + a[4]) * r + a[5]) * q /
+           (((((b[0] * r + b[1]) * r + b[2]) * r + b[3]) * r + b[4]) * r + 1);
+}
+
+void buildSizeTable(size_distribution_t *dist, size_table_t *table) {
+    table->min = dist->min;
+    double p0 = 0;
+    if (!dist->quantile && dist->stddev > 0)
+        p0 = 0.5 * erfc(-(dist->min - 0.5 - dist->mean) / (dist->stddev * M_SQRT2));
+
+    for (int i = 0; i < SIZE_TABLE_ENTRIES; i++) {
+        double u = (i + 0.5) / SIZE_TABLE_ENTRIES;
+        if (dist->quantile)
+            table->table[i] = dist->quantile((float)u);
+        else if (dist->stddev > 0)
+            table->table[i] = (float)(dist->mean + dist->stddev * inverseNormalCDF(p0 + (1 - p0) * u));
+        else
+            table->table[i] = dist->mean;
+    }
+    table->table[SIZE_TABLE_ENTRIES] = table->table[SIZE_TABLE_ENTRIES - 1];
+}
+
+void sampleSizes(size_table_t *table, uint64_t seed, int stream, int begin, int count, float *out) {
+    const float *t = table->table;
+    float min = table->min;
+    #pragma omp simd
+    for (int k = 0; k < count; k++) {
+        // position in slice-midpoint coordinates, clamped to the tabulated range
+        float pos = (float)rngUniform(seed, begin + k, stream, 0) * SIZE_TABLE_ENTRIES - 0.5f;
+        pos = std::min(std::max(pos, 0.0f), (float)(SIZE_TABLE_ENTRIES - 1));
+        int i = (int)pos;
+        float frac = pos - i;
+        float x = t[i] + (t[i + 1] - t[i]) * frac;
+        out[k] = std::max(roundf(x), min);
+    }
+}
@@ -0,0 +1,21 @@
+/*
+ * Batched room size sampling.
+ *
+ * A size distribution is turned into an inverse-CDF table once, and sizes are
+ * then drawn by looking up counter-based uniforms in the table, a block of
+ * rooms at a time. The normal is truncated inside the table (only the part of
+ * the CDF that rounds to at least min is tabulated), so no draw is ever
+ * rejected and the inner loop has no branches.
+ */
+
+#define SIZE_TABLE_ENTRIES 4096
+
+typedef struct {
+    float min;
+    float table[SIZE_TABLE_ENTRIES + 1];  // quantiles at evenly spaced u, last entry repeats for interpolation
+} size_table_t;
+
+void buildSizeTable(size_distribution_t *dist, size_table_t *table);
+
+/* Writes sizes of rooms begin .. begin + count - 1 to out, drawn from stream */
+void sampleSizes(size_table_t *table, uint64_t seed, int stream, int begin, int count, float *out);
@@ -0,0 +1,184 @@
+/*
+ * Pipelined batch scheduler
+ *
+ * One thread creates four OpenMP tasks per dungeon, layout, hallways, finish
+ * and sink, and the whole team runs them. Dungeon i lives in slot
+ * i % maxInFlight, and every task of a dungeon declares an inout dependence
+ * on its slot. That chains a dungeon's steps in order, and it also makes the
+ * first step of dungeon i + maxInFlight wait for the sink of dungeon i, which
+ * is what bounds the dungeons in flight without anyone blocking. The sink
+ * tasks also all depend on the sink argument, so they run in index order.
+ *
+ * Nested parallelism is switched off as in generateBatch, so the stages' own
+ * omp loops run on the thread that picked up the step. A step has no task
+ * scheduling points inside it, so a thread never interleaves two steps and
+ * its scratch arena is never shared between them.
+ *
+ * Under the stealing pool a dungeon is one pool task running its three steps
+ * back to back; dungeons on different threads are still at different steps,
+ * and the stages' pooled loops let idle threads help whichever dungeon is in a
+ * long step. A finished dungeon marks its slot ready and delivers every ready
+ * dungeon from the next undelivered index on, and each delivery forks the
+ * dungeon that reuses the slot, so there are never more than maxInFlight.
+ * With one thread, or from outside the pool, the OpenMP path runs instead.
+ */
+
+#include <cstdlib>
+#include <cstdint>
+#include <mutex>
+#include <omp.h>
+
+#include "generate.h"
+#include "graph.h"
+#include "tilemap.h"
+#include "validate.h"
+#include "cache.h"
+#include "pipeline.h"
+#include "scheduler.h"
+#include "pool.h"
+
+void defaultSchedulerParams(scheduler_params_t *params) {
+    params->maxInFlight = 0;
+}
+
+typedef struct {
+    gen_params_t *params;
+    int count;
+    int useRouting;
+    dungeon_cache_t *cache;
+    batch_sink_t sink;
+    void *ctx;
+    int inFlight;
+    pipeline_result_t *results;
+    gen_params_t *slotParams;
+    int *slotIndex;                // dungeon generated in each slot
+    int *slotReady;                // finished and not delivered yet
+    int next;                      // first dungeon not delivered yet
+    std::mutex lock;
+    pool_group_t group;
+} pipelined_batch_t;
+
+typedef struct {
+    pipelined_batch_t *batch;
+    int slot;
+} pipelined_job_t;
+
+static void runDungeon(void *arg);
+
+static void forkDungeon(pipelined_batch_t *batch, int i) {
+    int slot = i % batch->inFlight;
+    batch->slotIndex[slot] = i;
+    batch->slotReady[slot] = 0;
+    pipelined_job_t *job = (pipelined_job_t *)malloc(sizeof(pipelined_job_t));
+    job->batch = batch;
+    job->slot = slot;
+    poolFork(&batch->group, runDungeon, job);
+}
+
+static void runDungeon(void *arg) {
+    pipelined_job_t *job = (pipelined_job_t *)arg;
+    pipelined_batch_t *batch = job->batch;
+    int slot = job->slot;
+    free(job);
+
+    int i = batch->slotIndex[slot];
+    pipeline_result_t *result = &batch->results[slot];
+    gen_params_t *dungeon_params = &batch->slotParams[slot];
+    *dungeon_params = *batch->params;
+    dungeon_params->seed = batch->params->seed + i;
+    dungeon_params->verbose = 0;
+    pipelineLayout(dungeon_params, batch->useRouting, batch->cache, result);
+    pipelineHallways(dungeon_params, batch->useRouting, batch->cache, result);
+    pipelineFinish(dungeon_params, batch->useRouting, batch->cache, result);
+
+    std::lock_guard<std::mutex> guard(batch->lock);
+    batch->slotReady[slot] = 1;
+    while (batch->next < batch->count && batch->slotReady[batch->next % batch->inFlight]) {
+        int ready = batch->next % batch->inFlight;
+        batch->sink(batch->next, &batch->results[ready], batch->ctx);
+        freePipelineResult(&batch->results[ready]);
+        batch->slotReady[ready] = 0;
+        if (batch->next + batch->inFlight < batch->count)
+            forkDungeon(batch, batch->next + batch->inFlight);
+        batch->next++;
+    }
+}
+
+static void generatePooled(gen_params_t *params, int count, int useRouting, dungeon_cache_t *cache,
+                           int inFlight, batch_sink_t sink, void *ctx) {
+    pipelined_batch_t batch;
+    batch.params = params;
+    batch.count = count;
+    batch.useRouting = useRouting;
+    batch.cache = cache;
+    batch.sink = sink;
+    batch.ctx = ctx;
+    batch.inFlight = inFlight;
+    batch.results = (pipeline_result_t *)malloc(sizeof(pipeline_result_t) * inFlight);
+    batch.slotParams = (gen_params_t *)malloc(sizeof(gen_params_t) * inFlight);
+    batch.slotIndex = (int *)malloc(sizeof(int) * inFlight);
+    batch.slotReady = (int *)calloc(inFlight, sizeof(int));
+    batch.next = 0;
+    poolGroupInit(&batch.group);
+
+    // the caller runs steps too, its stages' omp loops go single threaded
+    int max_threads = omp_get_max_threads();
+    omp_set_num_threads(1);
+    {
+        std::lock_guard<std::mutex> guard(batch.lock);
+        for (int i = 0; i < count && i < inFlight; i++)
+            forkDungeon(&batch, i);
+    }
+    poolJoin(&batch.group);
+    omp_set_num_threads(max_threads);
+
+    free(batch.results);
+    free(batch.slotParams);
+    free(batch.slotIndex);
+    free(batch.slotReady);
+}
+
+void generatePipelined(gen_params_t *params, int count, int useRouting, dungeon_cache_t *cache,
+                       scheduler_params_t *sched, batch_sink_t sink, void *ctx) {
+    int inFlight = sched->maxInFlight > 0 ? sched->maxInFlight : 2 * poolThreads();
+    // forks that run inline would recurse a dungeon deeper per delivery
+    if (poolRuntime() == POOL_RUNTIME_STEALING && !poolInline()) {
+        generatePooled(params, count, useRouting, cache, inFlight, sink, ctx);
+        return;
+    }
+
+    pipeline_result_t *results = (pipeline_result_t *)malloc(sizeof(pipeline_result_t) * inFlight);
+    gen_params_t *slotParams = (gen_params_t *)malloc(sizeof(gen_params_t) * inFlight);
+
+    int max_levels = omp_get_max_active_levels();
+    omp_set_max_active_levels(1);
+
+    #pragma omp parallel
+    #pragma omp single
+    for (int i = 0; i < count; i++) {
+        int slot = i % inFlight;
+        pipeline_result_t *result = &results[slot];
+        gen_params_t *dungeon_params = &slotParams[slot];
+
+        #pragma omp task firstprivate(i, result, dungeon_params) depend(inout: results[slot])
+        {
+            *dungeon_params = *params;
+            dungeon_params->seed = params->seed + i;
+            dungeon_params->verbose = 0;
+            pipelineLayout(dungeon_params, useRouting, cache, result);
+        }
+        #pragma omp task firstprivate(result, dungeon_params) depend(inout: results[slot])
+        pipelineHallways(dungeon_params, useRouting, cache, result);
+        #pragma omp task firstprivate(result, dungeon_params) depend(inout: results[slot])
+        pipelineFinish(dungeon_params, useRouting, cache, result);
+        #pragma omp task firstprivate(i, result) depend(inout: results[slot], sink)
+        {
+            sink(i, result, ctx);
+            freePipelineResult(result);
+        }
+    }
+
+    omp_set_max_active_levels(max_levels);
+    free(results);
+    free(slotParams);
+}
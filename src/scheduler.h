@@ -0,0 +1,26 @@
+/*
+ * Pipelined batch generation.
+ *
+ * Runs a batch as a task graph of pipeline steps (see pipelineLayout) so the
+ * steps of different dungeons overlap: while one dungeon is in its serial
+ * Delaunay and MST step, others are separating rooms or rasterizing, and any
+ * idle thread takes whichever step is ready. At most maxInFlight dungeons are
+ * started and not yet handed to the sink, which bounds memory no matter how
+ * big the batch is, and the sink sees the dungeons in index order.
+ *
+ * Include after pipeline.h.
+ */
+
+typedef struct {
+    int maxInFlight;  // dungeons between their first step and the sink, <= 0 for twice the thread count
+} scheduler_params_t;
+
+void defaultSchedulerParams(scheduler_params_t *params);
+
+/*
+ * Generates count dungeons with seeds params->seed .. params->seed + count - 1
+ * like generateBatch, every step running single threaded. Sink calls are
+ * serialized and arrive in index order, each result is freed afterwards.
+ */
+void generatePipelined(gen_params_t *params, int count, int useRouting, dungeon_cache_t *cache,
+                       scheduler_params_t *sched, batch_sink_t sink, void *ctx);
@@ -0,0 +1,104 @@
+/*
+ * Uniform grid spatial index for hallway segments
+ */
+
+#include <cmath>
+#include <cstdlib>
+#include <algorithm>
+
+#include "generate.h"
+#include "spatial.h"
+#include "arena.h"
+
+// keeps a degenerate (all segments on one line) grid from having zero-sized cells
+#define MIN_CELL_SIZE 1.0f
+
+static int cellCoord(float value, float origin, float cellSize, int numCells) {
+    int c = (int)floor((value - origin) / cellSize);
+    return std::min(std::max(c, 0), numCells - 1);
+}
+
+segment_grid_t *buildSegmentGrid(segment_t *segments, int numSegments) {
+    arena_t *arena = scratchArena();
+    segment_grid_t *grid = (segment_grid_t *)arenaAlloc(arena, sizeof(segment_grid_t));
+
+    float minX = 0, minY = 0, maxX = 0, maxY = 0;
+    if (numSegments > 0) {
+        minX = maxX = segments[0].start.x;
+        minY = maxY = segments[0].start.y;
+    }
+    for (int i = 0; i < numSegments; i++) {
+        minX = std::min(minX, std::min(segments[i].start.x, segments[i].end.x));
+        maxX = std::max(maxX, std::max(segments[i].start.x, segments[i].end.x));
+        minY = std::min(minY, std::min(segments[i].start.y, segments[i].end.y));
+        maxY = std::max(maxY, std::max(segments[i].start.y, segments[i].end.y));
+    }
+
+    // Roughly one segment per cell, hallways are axis aligned so each one
+    // only covers a single row or column of cells
+    float area = (maxX - minX + MIN_CELL_SIZE) * (maxY - minY + MIN_CELL_SIZE);
+    float cellSize = std::max(MIN_CELL_SIZE, (float)sqrt(area / std::max(numSegments, 1)));
+    grid->minX = minX;
+    grid->minY = minY;
+    grid->cellSize = cellSize;
+    grid->cols = (int)floor((maxX - minX) / cellSize) + 1;
+    grid->rows = (int)floor((maxY - minY) / cellSize) + 1;
+
+    int numCells = grid->cols * grid->rows;
+    grid->cellStart = (int *)arenaCalloc(arena, numCells + 1, sizeof(int));
+
+    // Count pass, shifted by one for the prefix sum
+    for (int i = 0; i < numSegments; i++) {
+        int c0 = cellCoord(std::min(segments[i].start.x, segments[i].end.x), minX, cellSize, grid->cols);
+        int c1 = cellCoord(std::max(segments[i].start.x, segments[i].end.x), minX, cellSize, grid->cols);
+        int r0 = cellCoord(std::min(segments[i].start.y, segments[i].end.y), minY, cellSize, grid->rows);
+        int r1 = cellCoord(std::max(segments[i].start.y, segments[i].end.y), minY, cellSize, grid->rows);
+        for (int r = r0; r <= r1; r++)
+            for (int c = c0; c <= c1; c++)
+                grid->cellStart[r * grid->cols + c + 1] += 1;
+    }
+    for (int c = 0; c < numCells; c++)
+        grid->cellStart[c + 1] += grid->cellStart[c];
+
+    // Fill pass, segments end up in increasing id order within each cell
+    int numEntries = grid->cellStart[numCells];
+    grid->cellSegments = (int *)arenaAlloc(arena, sizeof(int) * numEntries);
+    grid->loX = (float *)arenaAlloc(arena, sizeof(float) * numEntries);
+    grid->loY = (float *)arenaAlloc(arena, sizeof(float) * numEntries);
+    grid->hiX = (float *)arenaAlloc(arena, sizeof(float) * numEntries);
+    grid->hiY = (float *)arenaAlloc(arena, sizeof(float) * numEntries);
+    int *cursor = (int *)arenaAlloc(arena, sizeof(int) * numCells);
+    for (int c = 0; c < numCells; c++)
+        cursor[c] = grid->cellStart[c];
+    for (int i = 0; i < numSegments; i++) {
+        int c0 = cellCoord(std::min(segments[i].start.x, segments[i].end.x), minX, cellSize, grid->cols);
+        int c1 = cellCoord(std::max(segments[i].start.x, segments[i].end.x), minX, cellSize, grid->cols);
+        int r0 = cellCoord(std::min(segments[i].start.y, segments[i].end.y), minY, cellSize, grid->rows);
+        int r1 = cellCoord(std::max(segments[i].start.y, segments[i].end.y), minY, cellSize, grid->rows);
+        for (int r = r0; r <= r1; r++) {
+            for (int c = c0; c <= c1; c++) {
+                int k = cursor[r * grid->cols + c]++;
+                grid->cellSegments[k] = i;
+                grid->loX[k] = std::min(segments[i].start.x, segments[i].end.x);
+                grid->loY[k] = std::min(segments[i].start.y, segments[i].end.y);
+                grid->hiX[k] = std::max(segments[i].start.x, segments[i].end.x);
+                grid->hiY[k] = std::max(segments[i].start.y, segments[i].end.y);
+            }
+        }
+    }
+
+    return grid;
+}
+
+int segmentGridCellRange(segment_grid_t *grid, float left, float top, float right, float bottom,
+                         int *col0, int *row0, int *col1, int *row1) {
+    float maxX = grid->minX + grid->cols * grid->cellSize;
+    float maxY = grid->minY + grid->rows * grid->cellSize;
+    if (right < grid->minX || left > maxX || bottom < grid->minY || top > maxY)
+        return 0;
+    *col0 = cellCoord(left, grid->minX, grid->cellSize, grid->cols);
+    *col1 = cellCoord(right, grid->minX, grid->cellSize, grid->cols);
+    *row0 = cellCoord(top, grid->minY, grid->cellSize, grid->rows);
+    *row1 = cellCoord(bottom, grid->minY, grid->cellSize, grid->rows);
+    return 1;
+}
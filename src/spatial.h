@@ -0,0 +1,32 @@
+/*
+ * Uniform grid over hallway segments.
+ *
+ * Every segment is registered in each cell its bounding box touches, and the
+ * cells are stored CSR style so a query for a rectangle only walks the
+ * segments listed in the cells under that rectangle. The endpoint coordinates
+ * are also copied out per entry (low/high corner, structure-of-arrays) so the
+ * entries of a cell can be tested as one contiguous SIMD batch.
+ *
+ * The grid is built in the calling thread's scratch arena (see arena.h) and
+ * goes away with the caller's arenaRelease.
+ */
+
+typedef struct {
+    float minX;
+    float minY;
+    float cellSize;
+    int cols;
+    int rows;
+    int *cellStart;     // cols * rows + 1 entries, cell c owns [cellStart[c], cellStart[c + 1])
+    int *cellSegments;  // segment ids, a long segment is listed once per cell it crosses
+    float *loX;         // per entry, min(start.x, end.x)
+    float *loY;
+    float *hiX;         // per entry, max(start.x, end.x)
+    float *hiY;
+} segment_grid_t;
+
+segment_grid_t *buildSegmentGrid(segment_t *segments, int numSegments);
+
+/* Inclusive cell range covering a rectangle, returns 0 if it misses the grid entirely */
+int segmentGridCellRange(segment_grid_t *grid, float left, float top, float right, float bottom,
+                         int *col0, int *row0, int *col1, int *row1);
@@ -0,0 +1,275 @@
+/*
+ * Hallway merge and intersection sweep
+ *
+ * Merging: horizontal segments are grouped by y and vertical ones by x, sorted
+ * along their length, and runs that strictly overlap are joined. Only strict
+ * overlaps are merged, so the union covers exactly the same open intervals as
+ * the originals and getIncludedRooms gives the same result on either.
+ *
+ * Crossings: per band, horizontals are inserted into an ordered set at their
+ * left end and removed at their right end while sweeping x, and every
+ * vertical reports the active horizontals within its y range. That is
+ * O((n + k) log n) for n segments and k crossings. A horizontal lives in
+ * exactly one band and a vertical is queried in every band it spans, so each
+ * crossing is found once. Crossings are only recorded, the segments are not
+ * cut at them (see sweep.h).
+ *
+ * The band count only depends on the number of segments, so the output is
+ * the same for any number of threads.
+ *
+ * The segment lists and the banded segments and events are counted, then
+ * filled into the scratch arena. The crossings and the ordered set of active
+ * horizontals stay on the heap: they grow inside the parallel band loop, where
+ * the arena can't be used, and the crossing count is only known after the
+ * sweep.
+ */
+
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+#include <set>
+#include <algorithm>
+
+#include "generate.h"
+#include "sweep.h"
+#include "pool.h"
+#include "control.h"
+#include "arena.h"
+
+// segments per band the band count aims for
+#define SWEEP_BAND_SEGMENTS 512
+
+// segment with lo <= hi along its axis, pos is the fixed coordinate
+typedef struct {
+    float pos;
+    float lo;
+    float hi;
+    int hallway;
+} axis_segment_t;
+
+static bool axisLT(const axis_segment_t &a, const axis_segment_t &b) {
+    if (a.pos != b.pos)
+        return a.pos < b.pos;
+    return a.lo < b.lo;
+}
+
+static int bandOf(float pos, float minPos, float bandSize, int numBands) {
+    int b = (int)floor((pos - minPos) / bandSize);
+    return std::min(std::max(b, 0), numBands - 1);
+}
+
+// Sorts and merges collinear overlapping segments, banded by pos so the bands
+// can be merged independently. Returns the new count, the merged segments
+// replace the first ones in segs.
+static int mergeCollinear(axis_segment_t *segs, int numSegs, int numBands) {
+    if (numSegs == 0)
+        return 0;
+    float minPos = segs[0].pos;
+    float maxPos = segs[0].pos;
+    for (int i = 0; i < numSegs; i++) {
+        minPos = std::min(minPos, segs[i].pos);
+        maxPos = std::max(maxPos, segs[i].pos);
+    }
+    float bandSize = std::max((maxPos - minPos) / numBands, 1.0f);
+
+    // Counting sort into bands, each band keeps the input order
+    arena_t *arena = scratchArena();
+    arena_mark_t mark = arenaMark(arena);
+    int *bandStart = (int *)arenaCalloc(arena, numBands + 1, sizeof(int));
+    int *bandCount = (int *)arenaAlloc(arena, sizeof(int) * numBands);
+    axis_segment_t *banded = (axis_segment_t *)arenaAlloc(arena, sizeof(axis_segment_t) * numSegs);
+    for (int i = 0; i < numSegs; i++)
+        bandStart[bandOf(segs[i].pos, minPos, bandSize, numBands) + 1] += 1;
+    for (int b = 0; b < numBands; b++) {
+        bandStart[b + 1] += bandStart[b];
+        bandCount[b] = bandStart[b];
+    }
+    for (int i = 0; i < numSegs; i++)
+        banded[bandCount[bandOf(segs[i].pos, minPos, bandSize, numBands)]++] = segs[i];
+
+    parallelFor(0, numBands, 1, [&](int b) {
+        axis_segment_t *band = banded + bandStart[b];
+        int size = bandStart[b + 1] - bandStart[b];
+        bandCount[b] = 0;
+        if (size == 0)
+            return;
+        std::sort(band, band + size, axisLT);
+        int out = 0;
+        for (int i = 1; i < size; i++) {
+            if (band[i].pos == band[out].pos && band[i].lo < band[out].hi) {
+                band[out].hi = std::max(band[out].hi, band[i].hi);
+                band[out].hallway = std::min(band[out].hallway, band[i].hallway);
+            }
+            else {
+                band[++out] = band[i];
+            }
+        }
+        bandCount[b] = out + 1;
+    });
+
+    int n = 0;
+    for (int b = 0; b < numBands; b++) {
+        std::copy(banded + bandStart[b], banded + bandStart[b] + bandCount[b], segs + n);
+        n += bandCount[b];
+    }
+    arenaRelease(arena, mark);
+    return n;
+}
+
+// sweep events, ordered by x then insert < query < remove so touching counts
+#define EVENT_INSERT 0
+#define EVENT_QUERY  1
+#define EVENT_REMOVE 2
+
+typedef struct {
+    float x;
+    int type;
+    int index;
+} sweep_event_t;
+
+static bool eventLT(const sweep_event_t &a, const sweep_event_t &b) {
+    if (a.x != b.x)
+        return a.x < b.x;
+    if (a.type != b.type)
+        return a.type < b.type;
+    return a.index < b.index;
+}
+
+void mergeHallways(dungeon_t *dungeon) {
+    int numBands = std::max(1, dungeon->numSegments / SWEEP_BAND_SEGMENTS);
+
+    // Split by orientation, degenerate segments are kept untouched
+    arena_t *arena = scratchArena();
+    arena_mark_t mark = arenaMark(arena);
+    axis_segment_t *horizontals = (axis_segment_t *)arenaAlloc(arena, sizeof(axis_segment_t) * dungeon->numSegments);
+    axis_segment_t *verticals = (axis_segment_t *)arenaAlloc(arena, sizeof(axis_segment_t) * dungeon->numSegments);
+    segment_t *points = (segment_t *)arenaAlloc(arena, sizeof(segment_t) * dungeon->numSegments);
+    int numHorizontal = 0;
+    int numVertical = 0;
+    int numPoints = 0;
+    for (int i = 0; i < dungeon->numSegments; i++) {
+        segment_t *seg = &dungeon->segments[i];
+        if (seg->start.y == seg->end.y && seg->start.x != seg->end.x) {
+            axis_segment_t a = {seg->start.y, std::min(seg->start.x, seg->end.x), std::max(seg->start.x, seg->end.x), seg->hallway};
+            horizontals[numHorizontal++] = a;
+        }
+        else if (seg->start.x == seg->end.x && seg->start.y != seg->end.y) {
+            axis_segment_t a = {seg->start.x, std::min(seg->start.y, seg->end.y), std::max(seg->start.y, seg->end.y), seg->hallway};
+            verticals[numVertical++] = a;
+        }
+        else {
+            points[numPoints++] = *seg;
+        }
+    }
+
+    numHorizontal = mergeCollinear(horizontals, numHorizontal, numBands);
+    numVertical = mergeCollinear(verticals, numVertical, numBands);
+    // a cancelled generation keeps the merged segments and finds no crossings
+    int findCrossings = !genCancelled(dungeon->params.control);
+
+    // New segment list: horizontals, then verticals, then points
+    int numSegments = numHorizontal + numVertical + numPoints;
+    segment_t *segments = (segment_t *)malloc(sizeof(segment_t) * (numSegments > 0 ? numSegments : 1));
+    for (int i = 0; i < numHorizontal; i++)
+        segments[i] = {{horizontals[i].lo, horizontals[i].pos}, {horizontals[i].hi, horizontals[i].pos}, horizontals[i].hallway};
+    for (int i = 0; i < numVertical; i++)
+        segments[numHorizontal + i] = {{verticals[i].pos, verticals[i].lo}, {verticals[i].pos, verticals[i].hi}, verticals[i].hallway};
+    for (int i = 0; i < numPoints; i++)
+        segments[numHorizontal + numVertical + i] = points[i];
+
+    // Band the sweep by y
+    float minY = 0, maxY = 0;
+    if (numHorizontal > 0)
+        minY = maxY = horizontals[0].pos;
+    for (int i = 0; i < numHorizontal; i++) {
+        minY = std::min(minY, horizontals[i].pos);
+        maxY = std::max(maxY, horizontals[i].pos);
+    }
+    float bandSize = std::max((maxY - minY) / numBands, 1.0f);
+
+    // Events per band, counted first so every band gets its own range
+    int *eventStart = (int *)arenaCalloc(arena, numBands + 1, sizeof(int));
+    int *eventEnd = (int *)arenaAlloc(arena, sizeof(int) * numBands);
+    for (int i = 0; i < numHorizontal; i++)
+        eventStart[bandOf(horizontals[i].pos, minY, bandSize, numBands) + 1] += 2;
+    for (int i = 0; i < numVertical; i++) {
+        if (numHorizontal == 0 || verticals[i].hi < minY || verticals[i].lo > maxY)
+            continue;
+        int b0 = bandOf(verticals[i].lo, minY, bandSize, numBands);
+        int b1 = bandOf(verticals[i].hi, minY, bandSize, numBands);
+        for (int b = b0; b <= b1; b++)
+            eventStart[b + 1] += 1;
+    }
+    for (int b = 0; b < numBands; b++) {
+        eventStart[b + 1] += eventStart[b];
+        eventEnd[b] = eventStart[b];
+    }
+
+    sweep_event_t *events = (sweep_event_t *)arenaAlloc(arena, sizeof(sweep_event_t) * eventStart[numBands]);
+    for (int i = 0; i < numHorizontal; i++) {
+        int b = bandOf(horizontals[i].pos, minY, bandSize, numBands);
+        sweep_event_t insert = {horizontals[i].lo, EVENT_INSERT, i};
+        sweep_event_t remove = {horizontals[i].hi, EVENT_REMOVE, i};
+        events[eventEnd[b]++] = insert;
+        events[eventEnd[b]++] = remove;
+    }
+    for (int i = 0; i < numVertical; i++) {
+        if (numHorizontal == 0 || verticals[i].hi < minY || verticals[i].lo > maxY)
+            continue;
+        int b0 = bandOf(verticals[i].lo, minY, bandSize, numBands);
+        int b1 = bandOf(verticals[i].hi, minY, bandSize, numBands);
+        sweep_event_t query = {verticals[i].pos, EVENT_QUERY, i};
+        for (int b = b0; b <= b1; b++)
+            events[eventEnd[b]++] = query;
+    }
+
+    std::vector< std::vector<crossing_t> > bandCrossings(numBands);
+    parallelFor(0, numBands, 1, [&](int b) {
+        if (!findCrossings)
+            return;
+        sweep_event_t *first = events + eventStart[b];
+        sweep_event_t *last = events + eventEnd[b];
+        std::sort(first, last, eventLT);
+        std::set< std::pair<float, int> > active;
+        for (sweep_event_t *e = first; e != last; e++) {
+            int i = e->index;
+            if (e->type == EVENT_INSERT) {
+                active.insert(std::make_pair(horizontals[i].pos, i));
+            }
+            else if (e->type == EVENT_REMOVE) {
+                active.erase(std::make_pair(horizontals[i].pos, i));
+            }
+            else {
+                axis_segment_t *v = &verticals[i];
+                std::set< std::pair<float, int> >::iterator it = active.lower_bound(std::make_pair(v->lo, -1));
+                for (; it != active.end() && it->first <= v->hi; ++it) {
+                    axis_segment_t *h = &horizontals[it->second];
+                    // two segments ending at the same point form a corner, not a crossing
+                    int hEnd = (v->pos == h->lo || v->pos == h->hi);
+                    int vEnd = (h->pos == v->lo || h->pos == v->hi);
+                    if (hEnd && vEnd)
+                        continue;
+                    crossing_t c = {{v->pos, h->pos}, it->second, numHorizontal + i};
+                    bandCrossings[b].push_back(c);
+                }
+            }
+        }
+    });
+
+    int numCrossings = 0;
+    for (int b = 0; b < numBands; b++)
+        numCrossings += (int)bandCrossings[b].size();
+    crossing_t *crossings = (crossing_t *)malloc(sizeof(crossing_t) * (numCrossings > 0 ? numCrossings : 1));
+    int c = 0;
+    for (int b = 0; b < numBands; b++)
+        for (size_t k = 0; k < bandCrossings[b].size(); k++)
+            crossings[c++] = bandCrossings[b][k];
+
+    arenaRelease(arena, mark);
+    free(dungeon->segments);
+    free(dungeon->crossings);
+    dungeon->segments = segments;
+    dungeon->numSegments = numSegments;
+    dungeon->crossings = crossings;
+    dungeon->numCrossings = numCrossings;
+}
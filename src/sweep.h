@@ -0,0 +1,18 @@
+/*
+ * Sweep-line pass over the axis-aligned hallway segments.
+ *
+ * Collinear segments that overlap (share more than a single point) are merged
+ * into one, then a sweep over x reports every place a horizontal segment
+ * meets a vertical one, except the corner joints where two segments simply
+ * end at the same point. The work is split into horizontal bands that are
+ * processed in parallel.
+ *
+ * Segments are not cut at the crossings. A crossing can lie on a room wall,
+ * and the strict wall tests of getIncludedRooms would then miss a corridor
+ * cut there, so the merged segments keep their full length and the
+ * crossings are a separate list (dungeon->crossings, also exported in
+ * dungeon files) for consumers that want the pieces.
+ */
+
+/* Replaces dungeon->segments with the merged segments, fills crossings and numCrossings */
+void mergeHallways(dungeon_t *dungeon);
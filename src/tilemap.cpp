@@ -0,0 +1,227 @@
+/*
+ * Parallel rasterization of the dungeon into a packed tile map
+ *
+ * Rooms and hallway segments are first bucketed by the strips of
+ * TILE_STRIP_ROWS rows they touch, then every strip is rasterized
+ * independently: walls, then floors over them, then corridors. Corridors
+ * turn the walls they cross into doors and never overwrite floor.
+ */
+
+#include <cmath>
+#include <cstdlib>
+#include <cstdint>
+#include <algorithm>
+
+#include "generate.h"
+#include "geometry.h"
+#include "tilemap.h"
+#include "arena.h"
+#include "pool.h"
+#include "control.h"
+
+#define TILES_PER_WORD 32
+#define TILE_MASK 3ULL
+
+// every 2-bit field set to 01, multiply by a tile type to repeat it across a word
+#define TILE_REPEAT 0x5555555555555555ULL
+
+typedef struct {
+    int left;    // inclusive tile bounds, world coordinates
+    int top;
+    int right;
+    int bottom;
+} tile_rect_t;
+
+static tile_rect_t roomTiles(rectangle_t *room) {
+    float left, top, right, bottom;
+    tileSpan(room->center.x, room->width, &left, &right);
+    tileSpan(room->center.y, room->height, &top, &bottom);
+    tile_rect_t r = {(int)left, (int)top, (int)right, (int)bottom};
+    return r;
+}
+
+static tile_rect_t segmentTiles(segment_t *seg) {
+    tile_rect_t r;
+    r.left = (int)floor(std::min(seg->start.x, seg->end.x));
+    r.top = (int)floor(std::min(seg->start.y, seg->end.y));
+    r.right = (int)floor(std::max(seg->start.x, seg->end.x));
+    r.bottom = (int)floor(std::max(seg->start.y, seg->end.y));
+    return r;
+}
+
+static int getType(tilemap_t *map, int col, int row) {
+    uint64_t word = map->tiles[(size_t)row * map->wordsPerRow + col / TILES_PER_WORD];
+    return (int)((word >> ((col % TILES_PER_WORD) * 2)) & TILE_MASK);
+}
+
+static void setType(tilemap_t *map, int col, int row, int type) {
+    uint64_t *word = &map->tiles[(size_t)row * map->wordsPerRow + col / TILES_PER_WORD];
+    int shift = (col % TILES_PER_WORD) * 2;
+    *word = (*word & ~(TILE_MASK << shift)) | ((uint64_t)type << shift);
+}
+
+static void setDoor(tilemap_t *map, int col, int row) {
+    map->doors[(size_t)row * map->doorWordsPerRow + col / 64] |= 1ULL << (col % 64);
+}
+
+// Sets tiles [col0, col1] of a row to one type, a whole word at a time
+static void fillRun(tilemap_t *map, int row, int col0, int col1, int type) {
+    uint64_t *rowWords = &map->tiles[(size_t)row * map->wordsPerRow];
+    uint64_t pattern = TILE_REPEAT * (uint64_t)type;
+    for (int w = col0 / TILES_PER_WORD; w <= col1 / TILES_PER_WORD; w++) {
+        int first = std::max(col0 - w * TILES_PER_WORD, 0);
+        int last = std::min(col1 - w * TILES_PER_WORD, TILES_PER_WORD - 1);
+        uint64_t mask = (last == TILES_PER_WORD - 1) ? ~0ULL : ((1ULL << ((last + 1) * 2)) - 1);
+        mask &= ~((1ULL << (first * 2)) - 1);
+        rowWords[w] = (rowWords[w] & ~mask) | (pattern & mask);
+    }
+}
+
+// CSR buckets of item ids per strip
+typedef struct {
+    int *start;
+    int *items;
+} strip_buckets_t;
+
+static void bucketByStrip(tile_rect_t *rects, int numRects, int originY, int numStrips, strip_buckets_t *buckets,
+                          arena_t *arena) {
+    buckets->start = (int *)arenaCalloc(arena, numStrips + 1, sizeof(int));
+    for (int i = 0; i < numRects; i++) {
+        int s0 = (rects[i].top - originY) / TILE_STRIP_ROWS;
+        int s1 = (rects[i].bottom - originY) / TILE_STRIP_ROWS;
+        for (int s = s0; s <= s1; s++)
+            buckets->start[s + 1] += 1;
+    }
+    for (int s = 0; s < numStrips; s++)
+        buckets->start[s + 1] += buckets->start[s];
+
+    int total = buckets->start[numStrips];
+    buckets->items = (int *)arenaAlloc(arena, sizeof(int) * total);
+    int *cursor = (int *)arenaAlloc(arena, sizeof(int) * numStrips);
+    for (int s = 0; s < numStrips; s++)
+        cursor[s] = buckets->start[s];
+    for (int i = 0; i < numRects; i++) {
+        int s0 = (rects[i].top - originY) / TILE_STRIP_ROWS;
+        int s1 = (rects[i].bottom - originY) / TILE_STRIP_ROWS;
+        for (int s = s0; s <= s1; s++)
+            buckets->items[cursor[s]++] = i;
+    }
+}
+
+tilemap_t *rasterizeDungeon(dungeon_t *dungeon) {
+    // Collect tile rectangles of everything that gets drawn
+    arena_t *arena = scratchArena();
+    arena_mark_t mark = arenaMark(arena);
+    int numIncluded = 0;
+    tile_rect_t *rooms = (tile_rect_t *)arenaAlloc(arena, sizeof(tile_rect_t) * dungeon->numRooms);
+    for (int i = 0; i < dungeon->numRooms; i++) {
+        if (dungeon->rooms[i].status & BIT_INCLUDED)
+            rooms[numIncluded++] = roomTiles(&dungeon->rooms[i]);
+    }
+    int numSegments = dungeon->numSegments;
+    tile_rect_t *corridors = (tile_rect_t *)arenaAlloc(arena, sizeof(tile_rect_t) * numSegments);
+    for (int i = 0; i < numSegments; i++)
+        corridors[i] = segmentTiles(&dungeon->segments[i]);
+
+    // Map bounds
+    int left = 0, top = 0, right = 0, bottom = 0;
+    if (numIncluded > 0) {
+        left = rooms[0].left;
+        top = rooms[0].top;
+        right = rooms[0].right;
+        bottom = rooms[0].bottom;
+    }
+    for (int i = 0; i < numIncluded; i++) {
+        left = std::min(left, rooms[i].left);
+        top = std::min(top, rooms[i].top);
+        right = std::max(right, rooms[i].right);
+        bottom = std::max(bottom, rooms[i].bottom);
+    }
+    for (int i = 0; i < numSegments; i++) {
+        left = std::min(left, corridors[i].left);
+        top = std::min(top, corridors[i].top);
+        right = std::max(right, corridors[i].right);
+        bottom = std::max(bottom, corridors[i].bottom);
+    }
+
+    tilemap_t *map = (tilemap_t *)malloc(sizeof(tilemap_t));
+    map->originX = left;
+    map->originY = top;
+    map->width = right - left + 1;
+    map->height = bottom - top + 1;
+    map->wordsPerRow = (map->width + TILES_PER_WORD - 1) / TILES_PER_WORD;
+    map->doorWordsPerRow = (map->width + 63) / 64;
+    map->tiles = (uint64_t *)calloc((size_t)map->wordsPerRow * map->height, sizeof(uint64_t));
+    map->doors = (uint64_t *)calloc((size_t)map->doorWordsPerRow * map->height, sizeof(uint64_t));
+
+    int numStrips = (map->height + TILE_STRIP_ROWS - 1) / TILE_STRIP_ROWS;
+    strip_buckets_t roomBuckets;
+    strip_buckets_t corridorBuckets;
+    bucketByStrip(rooms, numIncluded, map->originY, numStrips, &roomBuckets, arena);
+    bucketByStrip(corridors, numSegments, map->originY, numStrips, &corridorBuckets, arena);
+
+    gen_control_t *control = dungeon->params.control;
+    parallelFor(0, numStrips, 1, [&](int s) {
+        if (genCancelled(control))
+            return;
+        int stripTop = s * TILE_STRIP_ROWS;
+        int stripBottom = std::min(stripTop + TILE_STRIP_ROWS, map->height) - 1;
+
+        // walls: full rectangle, floors carve the interior out afterwards
+        for (int k = roomBuckets.start[s]; k < roomBuckets.start[s + 1]; k++) {
+            tile_rect_t r = rooms[roomBuckets.items[k]];
+            int row0 = std::max(r.top - map->originY, stripTop);
+            int row1 = std::min(r.bottom - map->originY, stripBottom);
+            for (int row = row0; row <= row1; row++)
+                fillRun(map, row, r.left - map->originX, r.right - map->originX, TILE_WALL);
+        }
+        for (int k = roomBuckets.start[s]; k < roomBuckets.start[s + 1]; k++) {
+            tile_rect_t r = rooms[roomBuckets.items[k]];
+            if (r.right - r.left < 2 || r.bottom - r.top < 2)
+                continue;
+            int row0 = std::max(r.top + 1 - map->originY, stripTop);
+            int row1 = std::min(r.bottom - 1 - map->originY, stripBottom);
+            for (int row = row0; row <= row1; row++)
+                fillRun(map, row, r.left + 1 - map->originX, r.right - 1 - map->originX, TILE_FLOOR);
+        }
+
+        // corridors
+        for (int k = corridorBuckets.start[s]; k < corridorBuckets.start[s + 1]; k++) {
+            tile_rect_t r = corridors[corridorBuckets.items[k]];
+            int row0 = std::max(r.top - map->originY, stripTop);
+            int row1 = std::min(r.bottom - map->originY, stripBottom);
+            for (int row = row0; row <= row1; row++) {
+                for (int col = r.left - map->originX; col <= r.right - map->originX; col++) {
+                    int type = getType(map, col, row);
+                    if (type == TILE_EMPTY)
+                        setType(map, col, row, TILE_CORRIDOR);
+                    else if (type == TILE_WALL)
+                        setDoor(map, col, row);
+                }
+            }
+        }
+    });
+
+    arenaRelease(arena, mark);
+    return map;
+}
+
+void freeTilemap(tilemap_t *map) {
+    free(map->tiles);
+    free(map->doors);
+    free(map);
+}
+
+int tilemapGet(tilemap_t *map, int x, int y) {
+    int col = x - map->originX;
+    int row = y - map->originY;
+    if (col < 0 || row < 0 || col >= map->width || row >= map->height)
+        return TILE_EMPTY;
+    if ((map->doors[(size_t)row * map->doorWordsPerRow + col / 64] >> (col % 64)) & 1)
+        return TILE_DOOR;
+    return getType(map, col, row);
+}
+
+size_t tilemapBytes(const tilemap_t *map) {
+    return sizeof(uint64_t) * ((size_t)map->wordsPerRow + map->doorWordsPerRow) * map->height;
+}
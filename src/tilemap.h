@@ -0,0 +1,41 @@
+/*
+ * Packed tile map of the final dungeon.
+ *
+ * Tile types take 2 bits each (32 tiles per 64-bit word) and doors live in a
+ * separate 1 bit plane, so a 10k x 10k map is 25MB + 12.5MB. Rows are padded
+ * to whole words so horizontal strips of rows never share a word and can be
+ * rasterized by different threads.
+ */
+
+// 2-bit tile types stored in the type plane
+#define TILE_EMPTY    0
+#define TILE_FLOOR    1
+#define TILE_WALL     2
+#define TILE_CORRIDOR 3
+
+// returned by tilemapGet for wall tiles whose door bit is set
+#define TILE_DOOR     4
+
+// rows rasterized together by one thread
+#define TILE_STRIP_ROWS 64
+
+typedef struct {
+    int originX;        // world coordinate of tile column 0
+    int originY;        // world coordinate of tile row 0
+    int width;
+    int height;
+    int wordsPerRow;    // words per row in the type plane
+    int doorWordsPerRow;
+    uint64_t *tiles;
+    uint64_t *doors;
+} tilemap_t;
+
+/* Rasterizes included rooms (walls + floor) and hallway segments (corridors) */
+tilemap_t *rasterizeDungeon(dungeon_t *dungeon);
+void freeTilemap(tilemap_t *map);
+
+/* Tile type at a world tile coordinate, TILE_EMPTY outside the map */
+int tilemapGet(tilemap_t *map, int x, int y);
+
+/* Bytes used by both planes */
+size_t tilemapBytes(const tilemap_t *map);
@@ -0,0 +1,216 @@
+/*
+ * Connected components of the walkable tiles
+ *
+ * Each row is reduced to runs of consecutive walkable tiles straight from the
+ * packed planes, so the union-find works on runs instead of tiles. Runs are
+ * unioned with the overlapping runs of the row above inside each strip of
+ * TILE_STRIP_ROWS rows in parallel (strips touch disjoint runs), and the
+ * strip boundaries are stitched afterwards. Unions always hang the larger
+ * index under the smaller one, so a single forward pass flattens the forest.
+ */
+
+#include <cmath>
+#include <cstdlib>
+#include <cstdint>
+#include <algorithm>
+#include <omp.h>
+
+#include "generate.h"
+#include "tilemap.h"
+#include "validate.h"
+#include "arena.h"
+#include "pool.h"
+#include "control.h"
+
+typedef struct {
+    int start;  // first column
+    int end;    // last column, inclusive
+} run_t;
+
+// Gathers the even bits of a word (bit 2i -> bit i)
+static uint64_t compressEvenBits(uint64_t x) {
+    x &= 0x5555555555555555ULL;
+    x = (x | (x >> 1)) & 0x3333333333333333ULL;
+    x = (x | (x >> 2)) & 0x0F0F0F0F0F0F0F0FULL;
+    x = (x | (x >> 4)) & 0x00FF00FF00FF00FFULL;
+    x = (x | (x >> 8)) & 0x0000FFFF0000FFFFULL;
+    x = (x | (x >> 16)) & 0x00000000FFFFFFFFULL;
+    return x;
+}
+
+// Walkable bits of 64 tiles starting at column 64 * w. Floor (01) and
+// corridor (11) are the tile types with the low bit set; doors come from
+// their own plane.
+static uint64_t walkableWord(tilemap_t *map, int row, int w) {
+    uint64_t *types = &map->tiles[(size_t)row * map->wordsPerRow];
+    uint64_t low = compressEvenBits(types[w * 2]);
+    uint64_t high = (w * 2 + 1 < map->wordsPerRow) ? compressEvenBits(types[w * 2 + 1]) : 0;
+    return low | (high << 32) | map->doors[(size_t)row * map->doorWordsPerRow + w];
+}
+
+// Calls out(start, end) for every run of set bits in a row
+template <typename F>
+static void forEachRun(tilemap_t *map, int row, F out) {
+    int runStart = -1;
+    for (int w = 0; w < map->doorWordsPerRow; w++) {
+        uint64_t bits = walkableWord(map, row, w);
+        int base = w * 64;
+        int pos = 0;
+        while (pos < 64) {
+            if (runStart < 0) {
+                uint64_t rest = bits >> pos;
+                if (rest == 0)
+                    break;
+                pos += __builtin_ctzll(rest);
+                runStart = base + pos;
+            }
+            else {
+                uint64_t rest = ~bits >> pos;
+                if (rest == 0)
+                    break;
+                pos += __builtin_ctzll(rest);
+                out(runStart, base + pos - 1);
+                runStart = -1;
+            }
+        }
+    }
+    if (runStart >= 0)
+        out(runStart, map->width - 1);
+}
+
+static int findRoot(int *parent, int a) {
+    while (parent[a] != a) {
+        parent[a] = parent[parent[a]];
+        a = parent[a];
+    }
+    return a;
+}
+
+static void unionRuns(int *parent, int a, int b) {
+    a = findRoot(parent, a);
+    b = findRoot(parent, b);
+    if (a < b)
+        parent[b] = a;
+    else if (b < a)
+        parent[a] = b;
+}
+
+// Unions the runs of row with the overlapping runs of the row above
+static void unionRows(run_t *runs, int *rowStart, int *parent, int row) {
+    int i = rowStart[row - 1];
+    int j = rowStart[row];
+    while (i < rowStart[row] && j < rowStart[row + 1]) {
+        if (runs[i].end >= runs[j].start && runs[j].end >= runs[i].start)
+            unionRuns(parent, i, j);
+        if (runs[i].end < runs[j].end)
+            i++;
+        else
+            j++;
+    }
+}
+
+// Result of a cancelled validation, nothing known to be reachable
+static int cancelledValidation(validation_t *result) {
+    result->connected = 0;
+    result->numComponents = 0;
+    result->numDisconnected = 0;
+    result->disconnected = NULL;
+    return 0;
+}
+
+int validateDungeon(dungeon_t *dungeon, tilemap_t *map, validation_t *result) {
+    int height = map->height;
+    gen_control_t *control = dungeon->params.control;
+    if (genCancelled(control))
+        return cancelledValidation(result);
+
+    // Count and then fill the runs of every row
+    arena_t *arena = scratchArena();
+    arena_mark_t mark = arenaMark(arena);
+    int *rowStart = (int *)arenaCalloc(arena, height + 1, sizeof(int));
+    parallelFor(0, height, 16, [&](int row) {
+        int count = 0;
+        forEachRun(map, row, [&](int, int) { count++; });
+        rowStart[row + 1] = count;
+    });
+    for (int row = 0; row < height; row++)
+        rowStart[row + 1] += rowStart[row];
+
+    int numRuns = rowStart[height];
+    // the passes are checked between, not inside, so runs and parent stay consistent
+    if (genCancelled(control)) {
+        arenaRelease(arena, mark);
+        return cancelledValidation(result);
+    }
+    run_t *runs = (run_t *)arenaAlloc(arena, sizeof(run_t) * numRuns);
+    int *parent = (int *)arenaAlloc(arena, sizeof(int) * numRuns);
+    parallelFor(0, height, 16, [&](int row) {
+        int k = rowStart[row];
+        forEachRun(map, row, [&](int start, int end) {
+            runs[k].start = start;
+            runs[k].end = end;
+            parent[k] = k;
+            k++;
+        });
+    });
+
+    // Union inside strips in parallel, then across strip boundaries
+    int numStrips = (height + TILE_STRIP_ROWS - 1) / TILE_STRIP_ROWS;
+    parallelFor(0, numStrips, 1, [&](int s) {
+        int rowEnd = std::min((s + 1) * TILE_STRIP_ROWS, height);
+        for (int row = s * TILE_STRIP_ROWS + 1; row < rowEnd; row++)
+            unionRows(runs, rowStart, parent, row);
+    });
+    for (int s = 1; s < numStrips; s++)
+        unionRows(runs, rowStart, parent, s * TILE_STRIP_ROWS);
+    if (genCancelled(control)) {
+        arenaRelease(arena, mark);
+        return cancelledValidation(result);
+    }
+
+    // parent[i] <= i, so roots are final after one forward pass
+    int numComponents = 0;
+    for (int i = 0; i < numRuns; i++) {
+        parent[i] = parent[parent[i]];
+        if (parent[i] == i)
+            numComponents += 1;
+    }
+
+    // Component of each main room, taken at its center tile
+    int numMain = dungeon->numMainRooms;
+    int *component = (int *)arenaAlloc(arena, sizeof(int) * numMain);
+    #pragma omp parallel for
+    for (int m = 0; m < numMain; m++) {
+        rectangle_t *room = &dungeon->rooms[dungeon->mainRoomIndices[m]];
+        int col = (int)floor(room->center.x) - map->originX;
+        int row = (int)floor(room->center.y) - map->originY;
+        component[m] = -1;
+        if (row < 0 || row >= height)
+            continue;
+        run_t *first = runs + rowStart[row];
+        run_t *last = runs + rowStart[row + 1];
+        run_t key = {col, col};
+        run_t *r = std::lower_bound(first, last, key, [](const run_t &a, const run_t &b) { return a.end < b.start; });
+        if (r != last && r->start <= col && col <= r->end)
+            component[m] = parent[r - runs];
+    }
+
+    result->numComponents = numComponents;
+    result->numDisconnected = 0;
+    result->disconnected = (int *)malloc(sizeof(int) * (numMain > 0 ? numMain : 1));
+    int entrance = (numMain > 0) ? component[0] : -1;
+    for (int m = 0; m < numMain; m++) {
+        if (component[m] < 0 || component[m] != entrance)
+            result->disconnected[result->numDisconnected++] = m;
+    }
+    result->connected = (result->numDisconnected == 0);
+
+    arenaRelease(arena, mark);
+    return result->connected;
+}
+
+void freeValidation(validation_t *result) {
+    free(result->disconnected);
+    result->disconnected = NULL;
+    result->numDisconnected = 0;
+}
@@ -0,0 +1,18 @@
+/*
+ * Reachability validation on the rasterized dungeon.
+ *
+ * Floor, corridor and door tiles are walkable. Walkable runs of each tile row
+ * are connected with a union-find, and every main room has to end up in the
+ * same component as main room 0 (the entrance).
+ */
+
+typedef struct {
+    int connected;        // 1 if every main room is reachable from the entrance
+    int numComponents;    // walkable components in the whole map
+    int numDisconnected;
+    int *disconnected;    // main room numbers (indices into mainRoomIndices) that are cut off
+} validation_t;
+
+/* Returns result->connected */
+int validateDungeon(dungeon_t *dungeon, tilemap_t *map, validation_t *result);
+void freeValidation(validation_t *result);
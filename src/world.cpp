@@ -0,0 +1,232 @@
+/*
+ * World streaming
+ *
+ * The file is created at its final tile size up front and the tile region is
+ * memory mapped. Chunks are generated in batches of batchChunks consecutive
+ * chunk numbers, one chunk per thread, and every thread copies its chunk's own
+ * tiles (not the portal tiles it draws on its neighbours) straight into the
+ * chunk's block of the mapping. After a batch the rooms are appended in chunk
+ * order, and the batch's tile blocks are synced and dropped from memory, so
+ * the resident set stays at about one batch no matter how big the world is.
+ * The room index and the header are written last, so a file that was cut
+ * short never has a valid header.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "generate.h"
+#include "graph.h"
+#include "tilemap.h"
+#include "validate.h"
+#include "cache.h"
+#include "pipeline.h"
+#include "chunk.h"
+#include "world.h"
+#include "pool.h"
+
+#define WORLD_ALIGN 4096
+
+static uint64_t alignUp(uint64_t x) {
+    return (x + WORLD_ALIGN - 1) / WORLD_ALIGN * WORLD_ALIGN;
+}
+
+// Writes all of buf at offset, returns 0 on success
+static int writeAt(int fd, const void *buf, size_t len, uint64_t offset) {
+    const char *p = (const char *)buf;
+    while (len > 0) {
+        ssize_t n = pwrite(fd, p, len, (off_t)offset);
+        if (n <= 0)
+            return -1;
+        p += n;
+        len -= n;
+        offset += n;
+    }
+    return 0;
+}
+
+void defaultWorldParams(world_params_t *params) {
+    defaultChunkParams(&params->chunk);
+    params->chunksX = 16;
+    params->chunksY = 16;
+    params->batchChunks = 256;
+}
+
+// Copies the tiles chunk (cx, cy) owns from its tile map into its block,
+// door tiles keep their wall type and get their door bit set
+static void copyChunkTiles(tilemap_t *map, int x0, int y0, int size, uint64_t *block) {
+    int typeWords = size / 32;
+    int doorWords = size / 64;
+    uint64_t *types = block;
+    uint64_t *doors = block + (size_t)size * typeWords;
+    for (int r = 0; r < size; r++) {
+        for (int c = 0; c < size; c++) {
+            int type = tilemapGet(map, x0 + c, y0 + r);
+            if (type == TILE_DOOR) {
+                doors[r * doorWords + c / 64] |= 1ULL << (c % 64);
+                type = TILE_WALL;
+            }
+            types[r * typeWords + c / 32] |= (uint64_t)type << ((c % 32) * 2);
+        }
+    }
+}
+
+int streamWorld(world_params_t *params, const char *path, world_stats_t *stats) {
+    int size = params->chunk.chunkSize;
+    int numChunks = params->chunksX * params->chunksY;
+    int batch = std::max(params->batchChunks, 1);
+    // a chunk's tile rows are whole 64-bit words of door bits
+    if (size <= 0 || size % 64)
+        return -1;
+
+    world_header_t header;
+    memset(&header, 0, sizeof(header));
+    header.version = WORLD_VERSION;
+    header.chunkSize = size;
+    header.chunksX = params->chunksX;
+    header.chunksY = params->chunksY;
+    header.seed = params->chunk.gen.seed;
+    header.chunkTileBytes = (uint64_t)size * (size / 32 + size / 64) * sizeof(uint64_t);
+    header.tilesOffset = alignUp(sizeof(world_header_t));
+    header.roomsOffset = alignUp(header.tilesOffset + header.chunkTileBytes * numChunks);
+    stats->rooms = 0;
+    stats->mainRooms = 0;
+    stats->disconnectedChunks = 0;
+
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        return -1;
+    if (ftruncate(fd, (off_t)header.roomsOffset) != 0) {
+        close(fd);
+        return -1;
+    }
+    size_t tilesLength = header.roomsOffset - header.tilesOffset;
+    unsigned char *tiles = (unsigned char *)mmap(NULL, tilesLength, PROT_READ | PROT_WRITE, MAP_SHARED,
+                                                 fd, (off_t)header.tilesOffset);
+    if (tiles == MAP_FAILED) {
+        close(fd);
+        return -1;
+    }
+
+    uint64_t *index = (uint64_t *)malloc(sizeof(uint64_t) * (numChunks + 1));
+    pipeline_result_t *results = (pipeline_result_t *)malloc(sizeof(pipeline_result_t) * batch);
+    uint64_t roomsEnd = header.roomsOffset;
+    int failed = 0;
+
+    for (int first = 0; first < numChunks && !failed; first += batch) {
+        int count = std::min(batch, numChunks - first);
+
+        parallelFor(0, count, 1, [&](int i) {
+            int c = first + i;
+            int cx = c % params->chunksX;
+            int cy = c / params->chunksX;
+            generateChunk(&params->chunk, cx, cy, &results[i]);
+            copyChunkTiles(results[i].tilemap, cx * size, cy * size, size,
+                           (uint64_t *)(tiles + header.chunkTileBytes * c));
+        });
+
+        // rooms in chunk order, the portals at the end of each chunk are left out
+        for (int i = 0; i < count; i++) {
+            dungeon_t *dungeon = &results[i].dungeon;
+            int numRooms = dungeon->numRooms - CHUNK_PORTALS;
+            index[first + i] = header.numRooms;
+            if (!failed && writeAt(fd, dungeon->rooms, sizeof(rectangle_t) * numRooms, roomsEnd) != 0)
+                failed = 1;
+            roomsEnd += sizeof(rectangle_t) * numRooms;
+            header.numRooms += numRooms;
+            stats->mainRooms += dungeon->numMainRooms - CHUNK_PORTALS;
+            if (!results[i].validation.connected)
+                stats->disconnectedChunks += 1;
+            freePipelineResult(&results[i]);
+        }
+
+        // the batch's tiles are done, write them back and let the kernel drop them
+        uint64_t begin = header.chunkTileBytes * first / WORLD_ALIGN * WORLD_ALIGN;
+        uint64_t end = std::min(alignUp(header.chunkTileBytes * (first + count)), (uint64_t)tilesLength);
+        if (msync(tiles + begin, end - begin, MS_SYNC) != 0)
+            failed = 1;
+        madvise(tiles + begin, end - begin, MADV_DONTNEED);
+    }
+    index[numChunks] = header.numRooms;
+    stats->rooms = header.numRooms;
+
+    header.indexOffset = (roomsEnd + 7) / 8 * 8;
+    if (!failed)
+        failed = writeAt(fd, index, sizeof(uint64_t) * (numChunks + 1), header.indexOffset) != 0;
+    memcpy(header.magic, WORLD_MAGIC, 8);
+    if (!failed)
+        failed = writeAt(fd, &header, sizeof(header), 0) != 0;
+
+    munmap(tiles, tilesLength);
+    free(results);
+    free(index);
+    if (close(fd) != 0)
+        failed = 1;
+    return failed ? -1 : 0;
+}
+
+world_map_t *openWorld(const char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return NULL;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(world_header_t)) {
+        close(fd);
+        return NULL;
+    }
+    void *base = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED)
+        return NULL;
+
+    world_header_t *header = (world_header_t *)base;
+    uint64_t numChunks = (uint64_t)header->chunksX * header->chunksY;
+    uint64_t size = header->chunkSize;
+    if (memcmp(header->magic, WORLD_MAGIC, 8) != 0 || header->version != WORLD_VERSION ||
+        size == 0 || size % 64 || header->chunkTileBytes != size * (size / 32 + size / 64) * sizeof(uint64_t) ||
+        header->tilesOffset + header->chunkTileBytes * numChunks > (uint64_t)st.st_size ||
+        header->indexOffset + sizeof(uint64_t) * (numChunks + 1) > (uint64_t)st.st_size) {
+        munmap(base, st.st_size);
+        return NULL;
+    }
+
+    world_map_t *world = (world_map_t *)malloc(sizeof(world_map_t));
+    world->header = header;
+    world->base = (unsigned char *)base;
+    world->size = st.st_size;
+    world->index = (uint64_t *)(world->base + header->indexOffset);
+    world->rooms = (rectangle_t *)(world->base + header->roomsOffset);
+    return world;
+}
+
+void closeWorld(world_map_t *world) {
+    munmap(world->base, world->size);
+    free(world);
+}
+
+int worldTile(world_map_t *world, int x, int y) {
+    int size = world->header->chunkSize;
+    if (x < 0 || y < 0 || x >= (int)world->header->chunksX * size || y >= (int)world->header->chunksY * size)
+        return TILE_EMPTY;
+    uint64_t c = (uint64_t)(y / size) * world->header->chunksX + x / size;
+    uint64_t *block = (uint64_t *)(world->base + world->header->tilesOffset + world->header->chunkTileBytes * c);
+    int r = y % size;
+    int col = x % size;
+    uint64_t *doors = block + (size_t)size * (size / 32);
+    if ((doors[r * (size / 64) + col / 64] >> (col % 64)) & 1)
+        return TILE_DOOR;
+    return (int)((block[r * (size / 32) + col / 32] >> ((col % 32) * 2)) & 3);
+}
+
+rectangle_t *worldChunkRooms(world_map_t *world, int cx, int cy, int *numRooms) {
+    uint64_t c = (uint64_t)cy * world->header->chunksX + cx;
+    *numRooms = (int)(world->index[c + 1] - world->index[c]);
+    return world->rooms + world->index[c];
+}
@@ -0,0 +1,68 @@
+/*
+ * Out-of-core world generation.
+ *
+ * A world is a rectangle of chunks (see chunk.h) streamed straight to one
+ * file, a batch of chunks at a time, so memory use depends on the batch size
+ * and not on the size of the world. The file is laid out for memory mapping:
+ * a fixed-size tile block per chunk in chunk order, then the rooms of every
+ * chunk in chunk order with an offset index, so any tile or any chunk's rooms
+ * can be read back without loading the rest.
+ *
+ * Include after chunk.h.
+ */
+
+#define WORLD_MAGIC "DGNWORLD"
+#define WORLD_VERSION 1
+
+typedef struct {
+    chunk_params_t chunk;  // chunkSize must be a multiple of 64
+    int chunksX;           // world is chunks [0, chunksX) x [0, chunksY)
+    int chunksY;
+    int batchChunks;       // chunks held in memory at once
+} world_params_t;
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t chunkSize;
+    uint32_t chunksX;
+    uint32_t chunksY;
+    uint64_t seed;
+    uint64_t chunkTileBytes;  // tile block per chunk: 2-bit types, then door bits, row by row
+    uint64_t tilesOffset;
+    uint64_t indexOffset;     // chunksX * chunksY + 1 room offsets, chunk c owns [index[c], index[c + 1])
+    uint64_t roomsOffset;
+    uint64_t numRooms;
+} world_header_t;
+
+typedef struct {
+    uint64_t rooms;
+    uint64_t mainRooms;
+    int disconnectedChunks;
+} world_stats_t;
+
+void defaultWorldParams(world_params_t *params);
+
+/*
+ * Generates the world into path, returns 0 on success and -1 on an I/O error
+ * or a chunkSize that isn't a positive multiple of 64
+ */
+int streamWorld(world_params_t *params, const char *path, world_stats_t *stats);
+
+typedef struct {
+    world_header_t *header;
+    unsigned char *base;
+    size_t size;
+    uint64_t *index;
+    rectangle_t *rooms;
+} world_map_t;
+
+/* Maps a world file read-only, NULL if it can't be opened or isn't a world file */
+world_map_t *openWorld(const char *path);
+void closeWorld(world_map_t *world);
+
+/* TILE_* type of a world tile, TILE_EMPTY outside the world */
+int worldTile(world_map_t *world, int x, int y);
+
+/* Rooms of chunk (cx, cy), portals not included */
+rectangle_t *worldChunkRooms(world_map_t *world, int cx, int cy, int *numRooms);